@@ -151,6 +151,15 @@ private:
   int K;			    // current iteration #
   int **classes;		    // this is the labeled image
   double ***in_image_data;	    // Input image (in RGB color space)
+  double *moments;		    // summed-area tables of the color
+				    // components and their products,
+				    // see InitMoments()
+  double origin[3];		    // mean color of the image
+
+  void InitMoments();		    // fills moments
+  void RectMoments(int x, int y,    // sums of the 9 moments over a
+		   int w, int h,    // rectangle
+		   double *sums);
 
   void InitOutImage();
   void SetLuv();		    // Luv settings
@@ -809,6 +818,7 @@ ImageOperations::ImageOperations(wxWindow *_frame)
   covariance = invcov = NULL;
   denom = NULL;
   alpha = 0.1;
+  moments = NULL;
 }
 
 
@@ -908,37 +918,23 @@ void ImageOperations::CalculateMeanAndCovariance(int region)
   if (in_image != NULL)
     {
       int x, y, w, h;
-      int i, j, k;
-      double sum, sum2, sum3;
+      int k;
+      double s[9];
       ((MyFrame *)frame)->GetRegion(x, y, w, h, region);
 
+      // all sums over the rectangle in constant time
+      RectMoments(x, y, w, h, s);
+      double n = (double)w*h;
       for (k=0; k<3; k++)
 	{
-	  sum = sum2 = 0;
-	  for (i=y; i<y+h; ++i)
-	    for (j=x; j<x+w; ++j)
-	      {
-		sum += in_image_data[i][j][k];
-		sum2 += in_image_data[i][j][k]*in_image_data[i][j][k];
-	      }
-	  mean[k][region] = sum/(w*h);
-	  variance[k][region] = (sum2 - (sum*sum)/(w*h))/(w*h-1);
+	  mean[k][region] = origin[k] + s[k]/n;
+	  variance[k][region] = (s[3+k] - (s[k]*s[k])/n)/(n-1);
 	}
 		
       // compute covariances
-      sum = sum2 = sum3 = 0;
-      for (i=y; i<y+h; ++i)
-	for (j=x; j<x+w; ++j)
-	  {		// L-u covariance
-	    sum += (in_image_data[i][j][0]-mean[0][region])*(in_image_data[i][j][1]-mean[1][region]);
-	    // L-v covariance
-	    sum2 += (in_image_data[i][j][0]-mean[0][region])*(in_image_data[i][j][2]-mean[2][region]);
-	    // u-v covariance
-	    sum3 += (in_image_data[i][j][1]-mean[1][region])*(in_image_data[i][j][2]-mean[2][region]);
-	  }
-      covariance[0][region] = sum/(w*h);   // L-u covariance
-      covariance[1][region] = sum2/(w*h);  // L-v covariance
-      covariance[2][region] = sum3/(w*h);  // u-v covariance
+      covariance[0][region] = (s[6] - s[0]*s[1]/n)/n;   // L-u covariance
+      covariance[1][region] = (s[7] - s[0]*s[2]/n)/n;   // L-v covariance
+      covariance[2][region] = (s[8] - s[1]*s[2]/n)/n;   // u-v covariance
       // Compute elements of inverse covariance matrix
       // element (1,1)
       invcov[0][region] = variance[2][region] * variance[1][region] - covariance[2][region]*covariance[2][region];
@@ -1197,6 +1193,7 @@ void ImageOperations::SetLuv()
 	in_image_data[i][j][1] = luv_data[(i*width*3)+j*3+1];	//u
 	in_image_data[i][j][2] = luv_data[(i*width*3)+j*3+2];	//v
       }
+  InitMoments();
 
   // Scale Luv values into [0,255]
   scaled_luv_data = scale(luv_data);
@@ -1233,6 +1230,63 @@ void ImageOperations::SetLuv()
 
 }
 
+/* Summed-area tables of L, u, v, L*L, u*u, v*v, L*u, L*v and u*v:
+ * element (i,j) holds the 9 sums over the sites above and to the left
+ * of (i,j), so the mean and covariance of any training rectangle follow
+ * from its 4 corners. The components are taken relative to the mean
+ * color of the image, which keeps the sums of the products small and
+ * their differences accurate on large images.
+ */
+void ImageOperations::InitMoments()
+{
+  int i, j, k;
+  double r[9];			// sums of the row so far
+
+  for (k=0; k<3; k++)
+    {
+      origin[k] = 0;
+      for (i=0; i<height; i++)
+	for (j=0; j<width; j++)
+	  origin[k] += in_image_data[i][j][k];
+      origin[k] /= (double)width*height;
+    }
+
+  delete [] moments;
+  moments = new double[(size_t)(width+1)*(height+1)*9];
+  for (j=0; j<(width+1)*9; j++)
+    moments[j] = 0;
+  for (i=0; i<height; i++)
+    {
+      double *above = moments + (size_t)i*(width+1)*9;
+      double *row = above + (width+1)*9;
+      for (k=0; k<9; k++)
+	r[k] = row[k] = 0;
+      for (j=0; j<width; j++)
+	{
+	  double L = in_image_data[i][j][0] - origin[0];
+	  double u = in_image_data[i][j][1] - origin[1];
+	  double v = in_image_data[i][j][2] - origin[2];
+	  r[0] += L;   r[1] += u;   r[2] += v;
+	  r[3] += L*L; r[4] += u*u; r[5] += v*v;
+	  r[6] += L*u; r[7] += L*v; r[8] += u*v;
+	  for (k=0; k<9; k++)
+	    row[(j+1)*9+k] = above[(j+1)*9+k] + r[k];
+	}
+    }
+}
+
+
+void ImageOperations::RectMoments(int x, int y, int w, int h, double *sums)
+{
+  const double *a = moments + ((size_t)y*(width+1) + x)*9;
+  const double *b = a + w*9;
+  const double *c = a + (size_t)h*(width+1)*9;
+  const double *d = c + w*9;
+  for (int k=0; k<9; k++)
+    sums[k] = d[k] - b[k] - c[k] + a[k];
+}
+
+
 unsigned char *ImageOperations::scale(double *luv_vector)
 {
   int i, j, k;
@@ -0,0 +1,123 @@
+/******************************************************************
+ * Modul name : batch.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Concurrent batch segmentation (see batch.h).
+ *
+ *****************************************************************/
+
+#include <chrono>
+
+#include "batch.h"
+#include "pnmio.h"
+#include "threadpool.h"
+
+
+MRFBatch::MRFBatch(MRFEngine &_model, int _method): model(_model)
+{
+  method = _method;
+  jobs = 0;
+  n = 0;
+  engines = NULL;
+  ok = NULL;
+  iterations = NULL;
+  energy = NULL;
+  wall_time = 0.0;
+}
+
+
+MRFBatch::~MRFBatch()
+{
+  delete [] ok;
+  delete [] iterations;
+  delete [] energy;
+}
+
+
+bool MRFBatch::Segment(MRFEngine &engine, int k)
+{
+  int width, height, channels;
+  unsigned char *data = ReadPNM(in_names[k], width, height, channels);
+  if (data == NULL) return false;
+  engine.SetImage(data, width, height, channels);
+  delete [] data;
+
+  engine.Optimize(method);
+  iterations[k] = engine.GetK();
+  energy[k] = engine.GetE();
+
+  data = new unsigned char[width*height];
+  for (int i=0; i<height; ++i)
+    for (int j=0; j<width; ++j)
+      data[i*width+j] = (unsigned char)engine.GetLabel(i, j);
+  bool written = WritePGM(out_names[k], data, width, height,
+			  engine.GetNoRegions()-1);
+  delete [] data;
+  return written;
+}
+
+
+void MRFBatch::Worker(void *arg, int thread)
+{
+  MRFBatch *b = (MRFBatch *)arg;
+  int k;
+
+  while (true)
+    {
+      {
+	std::lock_guard<std::mutex> lock(b->mutex);
+	k = b->next++;
+      }
+      if (k >= b->n) break;
+      b->ok[k] = b->Segment(b->engines[thread], k);
+    }
+}
+
+
+bool MRFBatch::Run(int _n, const char **_in_names, const char **_out_names)
+{
+  int k;
+
+  n = _n;
+  in_names = _in_names;
+  out_names = _out_names;
+  delete [] ok;
+  delete [] iterations;
+  delete [] energy;
+  ok = new bool[n];
+  iterations = new int[n];
+  energy = new double[n];
+  for (k=0; k<n; ++k)
+    {
+      ok[k] = false;
+      iterations[k] = 0;
+      energy[k] = 0.0;
+    }
+  next = 0;
+
+  int threads = (jobs > 0 ? jobs : ThreadPool::NoCores());
+  if (threads > n) threads = n;
+  if (threads < 1) threads = 1;
+  /* the engines are set up here, before any of them runs, since
+   * SetModel() initializes the shared tables of the model
+   */
+  engines = new MRFEngine[threads];
+  for (k=0; k<threads; ++k)
+    engines[k].SetModel(model);
+
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  {
+    ThreadPool pool(threads);
+    pool.Run(Worker, this);
+  }
+  wall_time = std::chrono::duration<double, std::milli>
+    (std::chrono::steady_clock::now() - start).count();
+
+  delete [] engines;
+  engines = NULL;
+
+  for (k=0; k<n; ++k)
+    if (!ok[k]) return false;
+  return true;
+}
@@ -0,0 +1,65 @@
+/******************************************************************
+ * Modul name : batch.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Concurrent segmentation of a batch of images with the same class
+ * parameters. Each thread of a ThreadPool has its own MRFEngine,
+ * set up from a common model engine (see MRFEngine::SetModel()), and
+ * takes the next image of the batch whenever it has finished one.
+ * The images are read and written as binary PGM/PPM files.
+ *
+ *****************************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <mutex>
+
+#include "mrfengine.h"
+
+
+class MRFBatch
+{
+public:
+  MRFBatch(MRFEngine &model,		// class parameters and settings
+	   int method);			// MRFEngine::METROPOLIS, ...
+  ~MRFBatch();
+
+  void SetJobs(int n) { jobs = n; }	// number of images segmented at
+					// the same time (0: one per core)
+  bool Run(int n,			// segments in_names[k] into
+	   const char **in_names,	// out_names[k], k=0..n-1. False
+	   const char **out_names);	// if any of them failed
+
+  bool IsOK(int k) { return ok[k]; }	// results of image k
+  int GetK(int k) { return iterations[k]; }
+  double GetE(int k) { return energy[k]; }
+  double GetWallTimeMs() { return wall_time; }
+  double GetImagesPerSec()		// aggregate throughput
+  {
+    return wall_time > 0 ? n*1000.0/wall_time : 0.0;
+  }
+
+private:
+  MRFEngine &model;
+  int method;
+  int jobs;
+  int n;				// images of the last Run()
+  const char **in_names, **out_names;
+  MRFEngine *engines;			// one per thread
+  bool *ok;
+  int *iterations;
+  double *energy;
+  double wall_time;			// of the last Run() in ms
+  int next;				// next image to be segmented
+  std::mutex mutex;			// protects next
+
+  static void Worker(void *batch, int thread);
+  bool Segment(MRFEngine &engine, int k);
+
+  MRFBatch(const MRFBatch &);		// not copyable
+  MRFBatch &operator=(const MRFBatch &);
+};
+
+
+#endif
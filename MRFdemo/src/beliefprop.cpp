@@ -0,0 +1,253 @@
+/******************************************************************
+ * Modul name : beliefprop.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Min-sum belief propagation and TRW-S on a 4-connected grid with
+ * the Potts potential (see beliefprop.h).
+ *
+ *****************************************************************/
+
+#include <string.h>
+
+#include "beliefprop.h"
+#include "threadpool.h"
+
+
+GridBP::GridBP()
+{
+  width = height = no_labels = padded = 0;
+  site_stride = 0;
+  weight = 0.0f;
+  costs = NULL;
+  capacity = 0;
+  work = NULL;
+  no_threads = 0;
+  color = 0;
+}
+
+
+GridBP::~GridBP()
+{
+  AlignedFree(costs);
+  AlignedFree(work);
+}
+
+
+void GridBP::Init(int w, int h, int n, float _weight, int _no_threads)
+{
+  width = w;
+  height = h;
+  no_labels = n;
+  padded = (n + BP_BLOCK - 1) / BP_BLOCK * BP_BLOCK;
+  site_stride = 5*(size_t)padded;
+  weight = _weight;
+  size_t size = site_stride*w*h;
+  if (size > capacity)
+    {
+      AlignedFree(costs);
+      costs = (float *)AlignedAlloc(size*sizeof(float));
+      capacity = size;
+    }
+  if (_no_threads < 1) _no_threads = 1;
+  AlignedFree(work);
+  work = (float *)AlignedAlloc(2*(size_t)padded*_no_threads*sizeof(float));
+  no_threads = _no_threads;
+
+  memset(costs, 0, size*sizeof(float));
+  for (size_t p=0; p<(size_t)w*h; ++p)
+    for (int l=n; l<padded; ++l)
+      costs[p*site_stride + l] = BP_PAD;
+}
+
+
+void GridBP::Belief(int p, float gamma, float *__restrict b)
+{
+  const float *__restrict u = Unary(p);
+  const float *__restrict e = Message(p, EAST);
+  const float *__restrict s = Message(p, SOUTH);
+  const float *__restrict w = Message(p, WEST);
+  const float *__restrict n = Message(p, NORTH);
+  for (int a=0; a<padded; a+=BP_BLOCK)
+    for (int k=0; k<BP_BLOCK; ++k)
+      b[a+k] = gamma*(u[a+k] + e[a+k] + s[a+k] + w[a+k] + n[a+k]);
+}
+
+
+/* The message of the costs h: m(b) = min_a h(a) + w*(a != b), made
+ * to have 0 as its minimum. If w >= 0 that is min(h(b) - m1, w) where
+ * m1 is the smallest cost; otherwise the message is -w lower at every
+ * label but the one of the smallest cost (k1), whose message also
+ * depends on the second smallest cost m2.
+ */
+void GridBP::Send(int i, int j, int dir, const float *__restrict b,
+		  float *__restrict h)
+{
+  int p = i*width + j;
+  int q = p + (dir == EAST ? 1 : dir == WEST ? -1 :
+	       dir == SOUTH ? width : -width);
+  const float *__restrict in = Message(p, dir); // excluded from the
+						// belief
+  float *__restrict m = Message(q, (dir+2)&3);
+  float lo[BP_BLOCK];
+  int a, k;
+
+  for (k=0; k<BP_BLOCK; ++k) lo[k] = BP_PAD;
+  for (a=0; a<padded; a+=BP_BLOCK)
+    for (k=0; k<BP_BLOCK; ++k)
+      {
+	float x = b[a+k] - in[a+k];
+	h[a+k] = x;
+	lo[k] = (x < lo[k] ? x : lo[k]);
+      }
+  float m1 = lo[0];
+  for (k=1; k<BP_BLOCK; ++k)
+    if (lo[k] < m1) m1 = lo[k];
+
+  float w = weight;
+  if (w >= 0.0f)
+    {
+      for (a=0; a<padded; a+=BP_BLOCK)
+	for (k=0; k<BP_BLOCK; ++k)
+	  {
+	    float x = h[a+k] - m1;
+	    m[a+k] = (x < w ? x : w);
+	  }
+    }
+  else
+    {
+      int k1 = 0;
+      float m2 = BP_PAD;
+      for (a=0; a<padded; ++a)
+	if (h[a] == m1)
+	  {
+	    k1 = a;
+	    break;
+	  }
+      for (a=0; a<padded; ++a)
+	{
+	  if (a != k1 && h[a] < m2) m2 = h[a];
+	  m[a] = 0.0f;
+	}
+      m[k1] = (m2 - m1 < -w ? m2 - m1 : -w);
+    }
+}
+
+
+/* Within a color the sites only read their own messages and write
+ * those of the other color, hence the bands are independent and the
+ * messages do not depend on the number of threads.
+ */
+void GridBP::Band(void *arg, int thread)
+{
+  GridBP *bp = (GridBP *)arg;
+  int i0 = thread * bp->height / bp->no_threads;
+  int i1 = (thread+1) * bp->height / bp->no_threads;
+  float *b = bp->work + 2*(size_t)bp->padded*thread;
+  float *h = b + bp->padded;
+
+  for (int i=i0; i<i1; ++i)
+    for (int j=(i+bp->color)%2; j<bp->width; j+=2)
+      {
+	bp->Belief(i*bp->width + j, 1.0f, b);
+	if (j < bp->width-1) bp->Send(i, j, EAST, b, h);
+	if (i < bp->height-1) bp->Send(i, j, SOUTH, b, h);
+	if (j > 0) bp->Send(i, j, WEST, b, h);
+	if (i > 0) bp->Send(i, j, NORTH, b, h);
+      }
+}
+
+
+void GridBP::Sweep(ThreadPool *pool)
+{
+  for (color=0; color<2; ++color)
+    if (pool != NULL)
+      pool->Run(Band, this);
+    else
+      for (int thread=0; thread<no_threads; ++thread)
+	Band(this, thread);
+}
+
+
+/* TRW-S on the trees formed by the rows and the columns: a site
+ * belongs to one tree of each, and sends a fraction gamma =
+ * 1/max(# of earlier, # of later neighbours) of its belief forward
+ * (backward). Unlike BP this never increases the lower bound of the
+ * energy the messages define.
+ */
+void GridBP::ForwardPass()
+{
+  float *b = work;
+  float *h = work + padded;
+
+  for (int i=0; i<height; ++i)
+    for (int j=0; j<width; ++j)
+      {
+	int earlier = (j > 0) + (i > 0);
+	int later = (j < width-1) + (i < height-1);
+	if (later == 0) continue;
+	Belief(i*width + j, 1.0f/(earlier > later ? earlier : later), b);
+	if (j < width-1) Send(i, j, EAST, b, h);
+	if (i < height-1) Send(i, j, SOUTH, b, h);
+      }
+}
+
+
+void GridBP::BackwardPass()
+{
+  float *b = work;
+  float *h = work + padded;
+
+  for (int i=height-1; i>=0; --i)
+    for (int j=width-1; j>=0; --j)
+      {
+	int earlier = (j > 0) + (i > 0);
+	int later = (j < width-1) + (i < height-1);
+	if (earlier == 0) continue;
+	Belief(i*width + j, 1.0f/(earlier > later ? earlier : later), b);
+	if (j > 0) Send(i, j, WEST, b, h);
+	if (i > 0) Send(i, j, NORTH, b, h);
+      }
+}
+
+
+/* The messages of the earlier neighbours are replaced by the Potts
+ * potential of their labels. The current label is kept on ties.
+ */
+long GridBP::Decode(label_t *labels, int stride)
+{
+  float *__restrict cost = work;
+  long changed = 0;
+
+  for (int i=0; i<height; ++i)
+    for (int j=0; j<width; ++j)
+      {
+	int p = i*width + j;
+	const float *__restrict u = Unary(p);
+	const float *__restrict e = Message(p, EAST);
+	const float *__restrict s = Message(p, SOUTH);
+	label_t *l = labels + (size_t)i*stride + j;
+	int a, k;
+	for (a=0; a<padded; a+=BP_BLOCK)
+	  for (k=0; k<BP_BLOCK; ++k)
+	    cost[a+k] = u[a+k] + e[a+k] + s[a+k];
+	if (j > 0)
+	  {
+	    for (a=0; a<no_labels; ++a) cost[a] += weight;
+	    cost[l[-1]] -= weight;
+	  }
+	if (i > 0)
+	  {
+	    for (a=0; a<no_labels; ++a) cost[a] += weight;
+	    cost[l[-stride]] -= weight;
+	  }
+	int best = *l;
+	for (a=0; a<no_labels; ++a)
+	  if (cost[a] < cost[best]) best = a;
+	if (best != *l)
+	  {
+	    *l = best;
+	    ++changed;
+	  }
+      }
+  return changed;
+}
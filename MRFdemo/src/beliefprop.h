@@ -0,0 +1,101 @@
+/******************************************************************
+ * Modul name : beliefprop.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Min-sum message passing on a 4-connected grid with the Potts
+ * pairwise potential w*(lp != lq): loopy belief propagation in
+ * checkerboard order (P. F. Felzenszwalb, D. P. Huttenlocher:
+ * Efficient Belief Propagation for Early Vision. IJCV 70(1), 2006)
+ * and sequential tree-reweighted message passing (V. Kolmogorov:
+ * Convergent Tree-Reweighted Message Passing for Energy Minimization.
+ * IEEE Trans. PAMI 28(10), 2006).
+ *
+ * With the Potts potential a message is computed in O(L) instead of
+ * O(L^2): m(b) = min(h(b), min_a h(a) + w). The unary costs of a site
+ * and the four messages it receives are stored next to each other in
+ * single precision, each padded to a multiple of BP_BLOCK labels, so
+ * the loops over the labels have a fixed trip count and are
+ * vectorized by the compiler.
+ *
+ *****************************************************************/
+
+#ifndef BELIEFPROP_H
+#define BELIEFPROP_H
+
+#include <stddef.h>
+
+#include "imagebuffer.h"
+
+class ThreadPool;
+
+#define BP_BLOCK 8			// labels are padded to a multiple
+					// of this
+#define BP_PAD 1e30f			// unary cost of the padding labels
+
+
+class GridBP
+{
+public:
+  enum { EAST, SOUTH, WEST, NORTH };	// directions of the neighbours
+
+  GridBP();
+  ~GridBP();
+
+  void Init(int w, int h,		// w*h sites (p = i*w+j) with
+	    int no_labels,		// no_labels labels, Potts weight
+	    float weight,		// (any sign) and work space for
+	    int no_threads=1);		// no_threads threads. All the
+					// messages are 0. Memory is
+					// reused.
+  float *Unary(int p)			// unary costs of site p (to be
+  {					// filled in by the caller)
+    return costs + (size_t)p*site_stride;
+  }
+  void Sweep(ThreadPool *pool);		// BP: every site sends its
+					// messages, the two colors of the
+					// checkerboard in turn, each on
+					// the threads of pool (it must
+					// have no_threads threads; NULL:
+					// serial)
+  void ForwardPass();			// TRW-S: every site sends its
+  void BackwardPass();			// messages to the later (earlier)
+					// neighbours, in raster order
+					// (reverse raster order)
+  long Decode(label_t *labels,		// labels each site in raster
+	      int stride);		// order given the labels of its
+					// earlier neighbours and the
+					// messages of the later ones.
+					// Returns the # of changed labels
+
+private:
+  int width, height, no_labels;
+  int padded;				// no_labels rounded up to BP_BLOCK
+  size_t site_stride;			// 5*padded
+  float weight;
+  float *costs;				// [p*site_stride + k*padded + l]:
+					// k=0 the unary cost, k=1+d the
+					// message from the neighbour in
+					// direction d
+  size_t capacity;			// allocated floats
+  float *work;				// 2*padded floats per thread
+  int no_threads;
+  int color;				// see Band()
+
+  float *Message(int p, int dir)	// message p receives from its
+  {					// neighbour in direction dir
+    return costs + (size_t)p*site_stride + (size_t)(dir+1)*padded;
+  }
+  void Belief(int p, float gamma,	// gamma*(unary cost + messages)
+	      float *b);
+  void Send(int i, int j, int dir,	// sends the message of the
+	    const float *b, float *h);	// belief b to the neighbour in
+					// direction dir (h: work space)
+  static void Band(void *bp,		// sites of the current color in
+		   int thread);		// the row band of a thread
+
+  GridBP(const GridBP &);		// not copyable
+  GridBP &operator=(const GridBP &);
+};
+
+
+#endif
@@ -0,0 +1,138 @@
+/******************************************************************
+ * Modul name : bitboard.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Bit-packed labeling of two-class segmentations: 64 sites per word,
+ * bit b of word w of row i is the label of site (i, 64*w+b). The
+ * labels of the 4 neighbours of all sites of a word are obtained by
+ * shifts, and the number of neighbours labeled 1 (and 0) of each
+ * site by bit-sliced adders: the k-th bit of the count of a site is
+ * the same bit of the k-th count word. See MRFEngine::RunBitboard().
+ *
+ *****************************************************************/
+
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "imagebuffer.h"
+
+
+/* Position of the lowest set bit of x (x != 0)
+ */
+inline int LowestBit(uint64_t x)
+{
+#ifdef _MSC_VER
+  unsigned long b;
+  _BitScanForward64(&b, x);
+  return (int)b;
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+
+class BitBoard
+{
+public:
+  BitBoard()
+  {
+    bits = NULL;
+    width = height = words = 0;
+    /* index of (label q, # of neighbours labeled 1, # labeled 0):
+     * q*9 + (# labeled q) - (# labeled 1-q) + 4
+     */
+    for (int k=0; k<128; ++k)
+      {
+	int q = k & 1, n1 = k >> 1 & 7, n0 = k >> 4 & 7;
+	index[k] = (unsigned char)(q*9 + (q ? n1-n0 : n0-n1) + 4);
+      }
+  }
+  ~BitBoard() { delete [] bits; }
+
+  void Pack(ImageBuffer<label_t> &labels) // labels must be 0 or 1
+  {
+    int i, j;
+    if (labels.GetWidth() != width || labels.GetHeight() != height)
+      {
+	delete [] bits;
+	width = labels.GetWidth();
+	height = labels.GetHeight();
+	words = (width + 63) / 64;
+	bits = new uint64_t[(size_t)words*height];
+      }
+    for (i=0; i<height; ++i)
+      {
+	uint64_t *r = Row(i);
+	const label_t *l = labels.Row(i);
+	for (j=0; j<words; ++j) r[j] = 0;
+	for (j=0; j<width; ++j)
+	  r[j >> 6] |= (uint64_t)(l[j] & 1) << (j & 63);
+      }
+  }
+
+  int GetWords() { return words; }	// words per row
+  uint64_t *Row(int i) { return bits + (size_t)i*words; }
+
+  /* Sites of a color ((i+j)%2) in word w of row i
+   */
+  uint64_t Sites(int i, int w, int color)
+  {
+    uint64_t m = ((i + color) & 1) ? 0xaaaaaaaaaaaaaaaaULL :
+      0x5555555555555555ULL;
+    if (w == words-1 && (width & 63) != 0)
+      m &= ((uint64_t)1 << (width & 63)) - 1;
+    return m;
+  }
+
+  /* Number of neighbours labeled 1 (n1) and 0 (n0) of the sites of
+   * word w of row i, 3 bit-sliced words each
+   */
+  void Counts(int i, int w, uint64_t *n1, uint64_t *n0)
+  {
+    const uint64_t all = ~(uint64_t)0;
+    const uint64_t *r = Row(i);
+    uint64_t c = r[w];
+    uint64_t vn = (i > 0 ? all : 0);	// masks of the existing
+    uint64_t vs = (i < height-1 ? all : 0); // neighbours
+    uint64_t vw = (w > 0 ? all : all << 1);
+    uint64_t ve = (w < words-1 ? all :
+		   ~((uint64_t)1 << ((width-1) & 63)));
+    uint64_t n = (i > 0 ? r[w-words] : 0);
+    uint64_t s = (i < height-1 ? r[w+words] : 0);
+    uint64_t west = c << 1 | (w > 0 ? r[w-1] >> 63 : 0);
+    uint64_t east = c >> 1 | (w < words-1 ? r[w+1] << 63 : 0);
+
+    Add4(n, s, west & vw, east & ve, n1);
+    Add4(~n & vn, ~s & vs, ~west & vw, ~east & ve, n0);
+  }
+
+  unsigned char index[128];		// see BitBoard()
+
+private:
+  uint64_t *bits;
+  int width, height;
+  int words;				// per row
+
+  /* sum of 4 bits in each position
+   */
+  static void Add4(uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+		   uint64_t *sum)
+  {
+    uint64_t s1 = a ^ b, c1 = a & b;
+    uint64_t s2 = c ^ d, c2 = c & d;
+    sum[0] = s1 ^ s2;
+    sum[1] = c1 ^ c2 ^ (s1 & s2);
+    sum[2] = c1 & c2;
+  }
+
+  BitBoard(const BitBoard &);		// not copyable
+  BitBoard &operator=(const BitBoard &);
+};
+
+
+#endif
@@ -0,0 +1,803 @@
+/******************************************************************
+ * Modul name : icmsimd.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Scalar, AVX2 and AVX-512 kernels of the checkerboard ICM. The
+ * vector kernels are compiled with function level target attributes
+ * and selected at run time, so the program still runs on CPUs
+ * without these instruction sets.
+ *
+ * The local energy of label r at a site with intensity g is
+ *   singletons[g*no_regions+r] + doubletons[4+nb-2*agree(r)]
+ * where nb is the number of neighbours and agree(r) is the number of
+ * neighbours labeled r. It is a single addition of two table entries
+ * in every kernel, so the vector and scalar results are identical.
+ * The same holds for the single precision and the 16 bit fixed point
+ * kernels among themselves; they only decide the labels, the energy
+ * change of a changed site is computed again in double precision.
+ *
+ *****************************************************************/
+
+#include "icmsimd.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && !defined(MRF_WIDE_LABELS)
+#define ICM_X86		// vector kernels (they assume 8 bit labels)
+#include <immintrin.h>
+#endif
+
+
+/* Label of minimal local energy at site (i,j). The current label is
+ * kept on ties, otherwise the smallest minimal label is chosen. dE is
+ * set to the change of the local energy.
+ */
+static inline int ICMSite(const ICMArgs &a, int i, int j, double &dE)
+{
+  const label_t *p = a.labels + (size_t)i*a.label_stride + j;
+  int n[4], nb = 0;	// neighbour labels
+  int q = *p;		// current label
+  int best = q;
+  int r, k, agree;
+  double e, bestE;
+
+  if (i!=a.height-1) n[nb++] = p[a.label_stride]; // south
+  if (j!=a.width-1) n[nb++] = p[1];		   // east
+  if (i!=0) n[nb++] = p[-a.label_stride];	   // nord
+  if (j!=0) n[nb++] = p[-1];			   // west
+
+  const double *S = a.singletons +
+    a.image[(size_t)i*a.image_stride + j]*a.no_regions;
+  const double *D = a.doubletons + 4 + nb;	   // D[-2*agree]
+
+  for (agree=0, k=0; k<nb; ++k) agree += (n[k] == q);
+  double curE = bestE = S[q] + D[-2*agree];
+  for (r=0; r<a.no_regions; ++r)
+    {
+      for (agree=0, k=0; k<nb; ++k) agree += (n[k] == r);
+      e = S[r] + D[-2*agree];
+      if (e < bestE)
+	{
+	  bestE = e;
+	  best = r;
+	}
+    }
+  dE = bestE - curE;
+  return best;
+}
+
+
+/* Updates site (i,j); returns 1 if its label has changed. The change
+ * of the energy is added to dE.
+ */
+static inline int ICMUpdate(const ICMArgs &a, int i, int j, double &dE)
+{
+  label_t *p = a.labels + (size_t)i*a.label_stride + j;
+  double d;
+  int r = ICMSite(a, i, j, d);
+  dE += d;
+  if (r == *p) return 0;
+  *p = (label_t)r;
+  return 1;
+}
+
+
+static int ICMScalar(const ICMArgs &a, int i0, int i1, int color)
+{
+  int changed = 0;
+  for (int i=i0; i<i1; ++i)
+    {
+      double dE = 0.0;
+      for (int j=(i+color)&1; j<a.width; j+=2)
+	changed += ICMUpdate(a, i, j, dE);
+      a.row_dE[i] += dE;
+    }
+  return changed;
+}
+
+
+void ICMReference(const ICMArgs &a, int i0, int i1, int color,
+		  label_t *out, int out_stride)
+{
+  double d;
+  for (int i=i0; i<i1; ++i)
+    for (int j=(i+color)&1; j<a.width; j+=2)
+      out[(size_t)i*out_stride + j] = (label_t)ICMSite(a, i, j, d);
+}
+
+
+/* Reduced precision
+ *
+ * Local energy of label r at site (i,j) in double precision (the same
+ * operations as in ICMSite())
+ */
+static inline double SiteEnergy(const ICMArgs &a, int i, int j, int r)
+{
+  const label_t *p = a.labels + (size_t)i*a.label_stride + j;
+  int nb = 0, agree = 0;
+
+  if (i!=a.height-1) { ++nb; agree += (p[a.label_stride] == r); }
+  if (j!=a.width-1) { ++nb; agree += (p[1] == r); }
+  if (i!=0) { ++nb; agree += (p[-a.label_stride] == r); }
+  if (j!=0) { ++nb; agree += (p[-1] == r); }
+  return a.singletons[a.image[(size_t)i*a.image_stride + j]*a.no_regions+r]
+    + a.doubletons[4 + nb - 2*agree];
+}
+
+
+/* Sets the label of site (i,j) to r; returns 1 if it has changed. The
+ * change of the energy is added to dE.
+ */
+static inline int SetLabel(const ICMArgs &a, int i, int j, int r, double &dE)
+{
+  label_t *p = a.labels + (size_t)i*a.label_stride + j;
+  int q = *p;
+  if (r == q) return 0;
+  dE += SiteEnergy(a, i, j, r) - SiteEnergy(a, i, j, q);
+  *p = (label_t)r;
+  return 1;
+}
+
+
+static inline const float *Singletons(const ICMArgs &a, float)
+{
+  return a.singletons32;
+}
+static inline const float *Doubletons(const ICMArgs &a, float)
+{
+  return a.doubletons32;
+}
+static inline const short *Singletons(const ICMArgs &a, short)
+{
+  return a.singletons16;
+}
+static inline const short *Doubletons(const ICMArgs &a, short)
+{
+  return a.doubletons16;
+}
+
+
+/* ICMUpdate() in reduced precision. T is float or short, Sum is the
+ * type of their sums (float or int).
+ */
+template <class T, class Sum>
+static inline int ICMUpdateReduced(const ICMArgs &a, int i, int j, double &dE)
+{
+  const label_t *p = a.labels + (size_t)i*a.label_stride + j;
+  int n[4], nb = 0;	// neighbour labels
+  int q = *p;		// current label
+  int best = q;
+  int r, k, agree;
+  Sum e, bestE;
+
+  if (i!=a.height-1) n[nb++] = p[a.label_stride]; // south
+  if (j!=a.width-1) n[nb++] = p[1];		   // east
+  if (i!=0) n[nb++] = p[-a.label_stride];	   // nord
+  if (j!=0) n[nb++] = p[-1];			   // west
+
+  const T *S = Singletons(a, T()) +
+    a.image[(size_t)i*a.image_stride + j]*a.no_regions;
+  const T *D = Doubletons(a, T()) + 4 + nb;	   // D[-2*agree]
+
+  for (agree=0, k=0; k<nb; ++k) agree += (n[k] == q);
+  bestE = (Sum)S[q] + (Sum)D[-2*agree];
+  for (r=0; r<a.no_regions; ++r)
+    {
+      for (agree=0, k=0; k<nb; ++k) agree += (n[k] == r);
+      e = (Sum)S[r] + (Sum)D[-2*agree];
+      if (e < bestE)
+	{
+	  bestE = e;
+	  best = r;
+	}
+    }
+  return SetLabel(a, i, j, best, dE);
+}
+
+
+template <class T, class Sum>
+static int ICMScalarReduced(const ICMArgs &a, int i0, int i1, int color)
+{
+  int changed = 0;
+  for (int i=i0; i<i1; ++i)
+    {
+      double dE = 0.0;
+      for (int j=(i+color)&1; j<a.width; j+=2)
+	changed += ICMUpdateReduced<T, Sum>(a, i, j, dE);
+      a.row_dE[i] += dE;
+    }
+  return changed;
+}
+
+
+#ifdef ICM_X86
+
+/* The vector kernels work on the inner sites only; the first and
+ * last rows and the few sites near the left and right borders are
+ * handled by ICMUpdate(). For the inner rows it is safe to read a
+ * few bytes beyond the end of the row (it is either padding or the
+ * next row of the buffer).
+ */
+
+__attribute__((target("avx2")))
+static int ICMAVX2(const ICMArgs &a, int i0, int i1, int color)
+{
+  // byte k of a 16 byte load -> 32 bit lane, for k = 0,2,4,6 / 1,3,5,7
+  const __m128i even = _mm_setr_epi8(0,-1,-1,-1, 2,-1,-1,-1,
+				     4,-1,-1,-1, 6,-1,-1,-1);
+  const __m128i odd = _mm_setr_epi8(1,-1,-1,-1, 3,-1,-1,-1,
+				    5,-1,-1,-1, 7,-1,-1,-1);
+  const __m128i even2 = _mm_setr_epi8(2,-1,-1,-1, 4,-1,-1,-1,
+				      6,-1,-1,-1, 8,-1,-1,-1);
+  const __m128i vL = _mm_set1_epi32(a.no_regions);
+  const __m128i eight = _mm_set1_epi32(8);
+  const int ls = a.label_stride;
+  int changed = 0;
+  int i, j, r;
+  double dE, d[4];
+
+  for (i=i0; i<i1; ++i)
+    {
+      j = (i+color)&1;
+      dE = 0.0;
+      if (i==0 || i==a.height-1)
+	{
+	  for (; j<a.width; j+=2) changed += ICMUpdate(a, i, j, dE);
+	  a.row_dE[i] += dE;
+	  continue;
+	}
+      if (j==0)
+	{
+	  changed += ICMUpdate(a, i, 0, dE);
+	  j = 2;
+	}
+      label_t *row = a.labels + (size_t)i*ls;
+      const unsigned char *img = a.image + (size_t)i*a.image_stride;
+      for (; j+7<a.width; j+=8)	// sites j, j+2, j+4, j+6
+	{
+	  label_t *p = row + j;
+	  __m128i mid = _mm_loadu_si128((const __m128i *)(p-1));
+	  __m128i W = _mm_shuffle_epi8(mid, even);
+	  __m128i C = _mm_shuffle_epi8(mid, odd);
+	  __m128i E = _mm_shuffle_epi8(mid, even2);
+	  __m128i N = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(p-ls)),
+				       even);
+	  __m128i S = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(p+ls)),
+				       even);
+	  __m128i G = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)(img+j)),
+				       even);
+	  __m128i base = _mm_mullo_epi32(G, vL);
+
+	  // agree is minus the number of agreeing neighbours
+	  __m128i agree = _mm_add_epi32(_mm_add_epi32(_mm_cmpeq_epi32(N, C),
+						      _mm_cmpeq_epi32(S, C)),
+					_mm_add_epi32(_mm_cmpeq_epi32(W, C),
+						      _mm_cmpeq_epi32(E, C)));
+	  __m128i di = _mm_add_epi32(eight, _mm_add_epi32(agree, agree));
+	  __m256d curE =
+	    _mm256_add_pd(_mm256_i32gather_pd(a.singletons,
+					      _mm_add_epi32(base, C), 8),
+			  _mm256_i32gather_pd(a.doubletons, di, 8));
+	  __m256d bestE = curE;
+	  __m256d best = _mm256_cvtepi32_pd(C);
+
+	  for (r=0; r<a.no_regions; ++r)
+	    {
+	      __m128i vr = _mm_set1_epi32(r);
+	      agree = _mm_add_epi32(_mm_add_epi32(_mm_cmpeq_epi32(N, vr),
+						  _mm_cmpeq_epi32(S, vr)),
+				    _mm_add_epi32(_mm_cmpeq_epi32(W, vr),
+						  _mm_cmpeq_epi32(E, vr)));
+	      di = _mm_add_epi32(eight, _mm_add_epi32(agree, agree));
+	      __m256d e =
+		_mm256_add_pd(_mm256_i32gather_pd(a.singletons,
+						  _mm_add_epi32(base, vr), 8),
+			      _mm256_i32gather_pd(a.doubletons, di, 8));
+	      __m256d less = _mm256_cmp_pd(e, bestE, _CMP_LT_OQ);
+	      bestE = _mm256_blendv_pd(bestE, e, less);
+	      best = _mm256_blendv_pd(best, _mm256_set1_pd(r), less);
+	    }
+
+	  __m128i labels = _mm256_cvttpd_epi32(best);
+	  int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(labels, C)));
+	  changed += 4 - __builtin_popcount(same);
+	  p[0] = (label_t)_mm_extract_epi32(labels, 0);
+	  p[2] = (label_t)_mm_extract_epi32(labels, 1);
+	  p[4] = (label_t)_mm_extract_epi32(labels, 2);
+	  p[6] = (label_t)_mm_extract_epi32(labels, 3);
+	  _mm256_storeu_pd(d, _mm256_sub_pd(bestE, curE));
+	  dE += d[0]; dE += d[1]; dE += d[2]; dE += d[3]; // in site order
+	}
+      for (; j<a.width; j+=2) changed += ICMUpdate(a, i, j, dE);
+      a.row_dE[i] += dE;
+    }
+  return changed;
+}
+
+
+__attribute__((target("avx512f,avx2")))
+static int ICMAVX512(const ICMArgs &a, int i0, int i1, int color)
+{
+  // even / odd bytes of a 16 byte load -> low 8 bytes
+  const __m128i even = _mm_setr_epi8(0,2,4,6,8,10,12,14,
+				     -1,-1,-1,-1,-1,-1,-1,-1);
+  const __m128i odd = _mm_setr_epi8(1,3,5,7,9,11,13,15,
+				    -1,-1,-1,-1,-1,-1,-1,-1);
+  const __m256i vL = _mm256_set1_epi32(a.no_regions);
+  const __m256i eight = _mm256_set1_epi32(8);
+  const int ls = a.label_stride;
+  int changed = 0;
+  int i, j, r, k;
+  int out[8];
+  double dE, d[8];
+
+  for (i=i0; i<i1; ++i)
+    {
+      j = (i+color)&1;
+      dE = 0.0;
+      if (i==0 || i==a.height-1)
+	{
+	  for (; j<a.width; j+=2) changed += ICMUpdate(a, i, j, dE);
+	  a.row_dE[i] += dE;
+	  continue;
+	}
+      if (j==0)
+	{
+	  changed += ICMUpdate(a, i, 0, dE);
+	  j = 2;
+	}
+      label_t *row = a.labels + (size_t)i*ls;
+      const unsigned char *img = a.image + (size_t)i*a.image_stride;
+      for (; j+15<a.width; j+=16)	// sites j, j+2, ..., j+14
+	{
+	  label_t *p = row + j;
+	  __m128i mid0 = _mm_loadu_si128((const __m128i *)(p-1));
+	  __m128i mid1 = _mm_loadu_si128((const __m128i *)(p+1));
+	  __m256i W = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(mid0, even));
+	  __m256i C = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(mid0, odd));
+	  __m256i E = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(mid1, even));
+	  __m256i N = _mm256_cvtepu8_epi32(
+	    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p-ls)), even));
+	  __m256i S = _mm256_cvtepu8_epi32(
+	    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+ls)), even));
+	  __m256i G = _mm256_cvtepu8_epi32(
+	    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(img+j)), even));
+	  __m256i base = _mm256_mullo_epi32(G, vL);
+
+	  // agree is minus the number of agreeing neighbours
+	  __m256i agree =
+	    _mm256_add_epi32(_mm256_add_epi32(_mm256_cmpeq_epi32(N, C),
+					      _mm256_cmpeq_epi32(S, C)),
+			     _mm256_add_epi32(_mm256_cmpeq_epi32(W, C),
+					      _mm256_cmpeq_epi32(E, C)));
+	  __m256i di = _mm256_add_epi32(eight, _mm256_add_epi32(agree, agree));
+	  __m512d curE =
+	    _mm512_add_pd(_mm512_i32gather_pd(_mm256_add_epi32(base, C),
+					      a.singletons, 8),
+			  _mm512_i32gather_pd(di, a.doubletons, 8));
+	  __m512d bestE = curE;
+	  __m512d best = _mm512_cvtepi32_pd(C);
+
+	  for (r=0; r<a.no_regions; ++r)
+	    {
+	      __m256i vr = _mm256_set1_epi32(r);
+	      agree =
+		_mm256_add_epi32(_mm256_add_epi32(_mm256_cmpeq_epi32(N, vr),
+						  _mm256_cmpeq_epi32(S, vr)),
+				 _mm256_add_epi32(_mm256_cmpeq_epi32(W, vr),
+						  _mm256_cmpeq_epi32(E, vr)));
+	      di = _mm256_add_epi32(eight, _mm256_add_epi32(agree, agree));
+	      __m512d e =
+		_mm512_add_pd(_mm512_i32gather_pd(_mm256_add_epi32(base, vr),
+						  a.singletons, 8),
+			      _mm512_i32gather_pd(di, a.doubletons, 8));
+	      __mmask8 less = _mm512_cmp_pd_mask(e, bestE, _CMP_LT_OQ);
+	      bestE = _mm512_mask_blend_pd(less, bestE, e);
+	      best = _mm512_mask_blend_pd(less, best, _mm512_set1_pd(r));
+	    }
+
+	  __m256i labels = _mm512_cvttpd_epi32(best);
+	  int same = _mm256_movemask_ps(
+	    _mm256_castsi256_ps(_mm256_cmpeq_epi32(labels, C)));
+	  changed += 8 - __builtin_popcount(same);
+	  _mm256_storeu_si256((__m256i *)out, labels);
+	  _mm512_storeu_pd(d, _mm512_sub_pd(bestE, curE));
+	  for (k=0; k<8; ++k)
+	    {
+	      p[2*k] = (label_t)out[k];
+	      dE += d[k];	// in site order
+	    }
+	}
+      for (; j<a.width; j+=2) changed += ICMUpdate(a, i, j, dE);
+      a.row_dE[i] += dE;
+    }
+  return changed;
+}
+
+
+
+/* Reduced precision vector kernels. They process 8, 16 or 32 sites of
+ * a row, which takes up to 4 loads of 16 bytes; Evens() gathers the
+ * bytes at even offsets of two such loads, Evens8() those of one.
+ * The loads must not reach beyond the sites of the vector in the row
+ * below (row i+1 may be the last one of the buffer), so a vector of n
+ * sites loads at most 2n bytes of a row.
+ */
+__attribute__((target("avx2")))
+static inline __m128i Evens(const unsigned char *p)
+{
+  const __m128i even = _mm_setr_epi8(0,2,4,6,8,10,12,14,
+				     -1,-1,-1,-1,-1,-1,-1,-1);
+  return _mm_unpacklo_epi64(
+    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), even),
+    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+16)), even));
+}
+
+
+__attribute__((target("avx2")))
+static inline __m128i Evens8(const unsigned char *p)
+{
+  const __m128i even = _mm_setr_epi8(0,2,4,6,8,10,12,14,
+				     -1,-1,-1,-1,-1,-1,-1,-1);
+  return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), even);
+}
+
+
+/* Writes the labels of the changed sites of a vector (bit k of changed
+ * is set if site p[2k] has changed) in site order.
+ */
+template <class T>
+static inline void StoreLabels(const ICMArgs &a, int i, int j,
+			       const T *labels, unsigned long long changed,
+			       double &dE)
+{
+  while (changed)
+    {
+      int k = __builtin_ctzll(changed);
+      changed &= changed - 1;
+      SetLabel(a, i, j+2*k, labels[k], dE);
+    }
+}
+
+
+/* Runs kernel on the inner part of the rows: sites j, j+2, ... of a
+ * vector of n sites; the rest is done by the scalar code.
+ */
+#define REDUCED_ROWS(T, Sum, n, ...)					\
+  int changed = 0;							\
+  for (int i=i0; i<i1; ++i)						\
+    {									\
+      int j = (i+color)&1;						\
+      double dE = 0.0;							\
+      if (i==0 || i==a.height-1)					\
+	{								\
+	  for (; j<a.width; j+=2)					\
+	    changed += ICMUpdateReduced<T, Sum>(a, i, j, dE);		\
+	  a.row_dE[i] += dE;						\
+	  continue;							\
+	}								\
+      if (j==0)								\
+	{								\
+	  changed += ICMUpdateReduced<T, Sum>(a, i, 0, dE);		\
+	  j = 2;							\
+	}								\
+      label_t *p;							\
+      const unsigned char *img;						\
+      for (; j+2*(n)-1<a.width; j+=2*(n))				\
+	{								\
+	  p = a.labels + (size_t)i*a.label_stride + j;			\
+	  img = a.image + (size_t)i*a.image_stride + j;			\
+	  __VA_ARGS__						\
+	}								\
+      for (; j<a.width; j+=2)						\
+	changed += ICMUpdateReduced<T, Sum>(a, i, j, dE);		\
+      a.row_dE[i] += dE;						\
+    }									\
+  return changed;
+
+
+__attribute__((target("avx2")))
+static int ICMAVX2Float(const ICMArgs &a, int i0, int i1, int color)
+{
+  const __m256i vL = _mm256_set1_epi32(a.no_regions);
+  const __m256i eight = _mm256_set1_epi32(8);
+  const int ls = a.label_stride;
+  int out[8];
+
+  REDUCED_ROWS(float, float, 8, {
+    __m256i W = _mm256_cvtepu8_epi32(Evens8(p-1));
+    __m256i C = _mm256_cvtepu8_epi32(Evens8(p));
+    __m256i E = _mm256_cvtepu8_epi32(Evens8(p+1));
+    __m256i N = _mm256_cvtepu8_epi32(Evens8(p-ls));
+    __m256i S = _mm256_cvtepu8_epi32(Evens8(p+ls));
+    __m256i base = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(Evens8(img)), vL);
+    __m256i agree =
+      _mm256_add_epi32(_mm256_add_epi32(_mm256_cmpeq_epi32(N, C),
+					_mm256_cmpeq_epi32(S, C)),
+		       _mm256_add_epi32(_mm256_cmpeq_epi32(W, C),
+					_mm256_cmpeq_epi32(E, C)));
+    __m256i di = _mm256_add_epi32(eight, _mm256_add_epi32(agree, agree));
+    __m256 bestE =
+      _mm256_add_ps(_mm256_i32gather_ps(a.singletons32,
+					_mm256_add_epi32(base, C), 4),
+		    _mm256_i32gather_ps(a.doubletons32, di, 4));
+    __m256i best = C;
+    for (int r=0; r<a.no_regions; ++r)
+      {
+	__m256i vr = _mm256_set1_epi32(r);
+	agree =
+	  _mm256_add_epi32(_mm256_add_epi32(_mm256_cmpeq_epi32(N, vr),
+					    _mm256_cmpeq_epi32(S, vr)),
+			   _mm256_add_epi32(_mm256_cmpeq_epi32(W, vr),
+					    _mm256_cmpeq_epi32(E, vr)));
+	di = _mm256_add_epi32(eight, _mm256_add_epi32(agree, agree));
+	__m256 e =
+	  _mm256_add_ps(_mm256_i32gather_ps(a.singletons32,
+					    _mm256_add_epi32(base, vr), 4),
+			_mm256_i32gather_ps(a.doubletons32, di, 4));
+	__m256 less = _mm256_cmp_ps(e, bestE, _CMP_LT_OQ);
+	bestE = _mm256_blendv_ps(bestE, e, less);
+	best = _mm256_blendv_epi8(best, vr, _mm256_castps_si256(less));
+      }
+    int same = _mm256_movemask_ps(
+      _mm256_castsi256_ps(_mm256_cmpeq_epi32(best, C)));
+    changed += 8 - __builtin_popcount(same);
+    _mm256_storeu_si256((__m256i *)out, best);
+    StoreLabels(a, i, j, out, ~same & 0xff, dE);
+  })
+}
+
+
+__attribute__((target("avx2")))
+static int ICMAVX2Fixed(const ICMArgs &a, int i0, int i1, int color)
+{
+  const __m256i vL = _mm256_set1_epi32(a.no_regions);
+  const __m256i beta2 = _mm256_set1_epi16(2*a.doubletons16[5]);
+  const __m256i beta4 = _mm256_set1_epi16(a.doubletons16[8]);
+  const int *S16 = (const int *)a.singletons16; // 32 bit gathers
+  const int ls = a.label_stride;
+  short out[16];
+
+  REDUCED_ROWS(short, int, 16, {
+    __m256i W = _mm256_cvtepu8_epi16(Evens(p-1));
+    __m256i C = _mm256_cvtepu8_epi16(Evens(p));
+    __m256i E = _mm256_cvtepu8_epi16(Evens(p+1));
+    __m256i N = _mm256_cvtepu8_epi16(Evens(p-ls));
+    __m256i S = _mm256_cvtepu8_epi16(Evens(p+ls));
+    __m128i G = Evens(img);
+    __m256i base0 = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(G), vL);
+    __m256i base1 = _mm256_mullo_epi32(
+      _mm256_cvtepu8_epi32(_mm_unpackhi_epi64(G, G)), vL);
+    __m256i bestE = C, best = C;
+    for (int r=-1; r<a.no_regions; ++r)	// r=-1: the current label
+      {
+	__m256i vr = (r < 0 ? C : _mm256_set1_epi16(r));
+	__m256i idx0 = _mm256_add_epi32(base0, r < 0 ?
+				      _mm256_cvtepu16_epi32(_mm256_castsi256_si128(C)) :
+				      _mm256_set1_epi32(r));
+	__m256i idx1 = _mm256_add_epi32(base1, r < 0 ?
+				      _mm256_cvtepu16_epi32(_mm256_extracti128_si256(C, 1)) :
+				      _mm256_set1_epi32(r));
+	// low 16 bits of the 32 bit gathers, sign extended and packed
+	__m256i s0 = _mm256_i32gather_epi32(S16, idx0, 2);
+	__m256i s1 = _mm256_i32gather_epi32(S16, idx1, 2);
+	s0 = _mm256_srai_epi32(_mm256_slli_epi32(s0, 16), 16);
+	s1 = _mm256_srai_epi32(_mm256_slli_epi32(s1, 16), 16);
+	__m256i s = _mm256_permute4x64_epi64(_mm256_packs_epi32(s0, s1), 0xd8);
+	// agree is minus the number of agreeing neighbours
+	__m256i agree =
+	  _mm256_add_epi16(_mm256_add_epi16(_mm256_cmpeq_epi16(N, vr),
+					    _mm256_cmpeq_epi16(S, vr)),
+			   _mm256_add_epi16(_mm256_cmpeq_epi16(W, vr),
+					    _mm256_cmpeq_epi16(E, vr)));
+	__m256i e = _mm256_add_epi16(s, _mm256_add_epi16(
+				       beta4, _mm256_mullo_epi16(agree, beta2)));
+	if (r < 0)
+	  bestE = e;
+	else
+	  {
+	    __m256i less = _mm256_cmpgt_epi16(bestE, e);
+	    bestE = _mm256_blendv_epi8(bestE, e, less);
+	    best = _mm256_blendv_epi8(best, vr, less);
+	  }
+      }
+    unsigned same = _mm256_movemask_epi8(_mm256_cmpeq_epi16(best, C));
+    unsigned long long diff = 0;
+    for (int k=0; k<16; ++k)
+      if (!(same >> 2*k & 1)) diff |= 1ull << k;
+    changed += __builtin_popcountll(diff);
+    _mm256_storeu_si256((__m256i *)out, best);
+    StoreLabels(a, i, j, out, diff, dE);
+  })
+}
+
+
+__attribute__((target("avx512f,avx2")))
+static int ICMAVX512Float(const ICMArgs &a, int i0, int i1, int color)
+{
+  const __m512i vL = _mm512_set1_epi32(a.no_regions);
+  const __m512i eight = _mm512_set1_epi32(8);
+  const int ls = a.label_stride;
+  int out[16];
+
+  REDUCED_ROWS(float, float, 16, {
+    __m512i W = _mm512_cvtepu8_epi32(Evens(p-1));
+    __m512i C = _mm512_cvtepu8_epi32(Evens(p));
+    __m512i E = _mm512_cvtepu8_epi32(Evens(p+1));
+    __m512i N = _mm512_cvtepu8_epi32(Evens(p-ls));
+    __m512i S = _mm512_cvtepu8_epi32(Evens(p+ls));
+    __m512i base = _mm512_mullo_epi32(_mm512_cvtepu8_epi32(Evens(img)), vL);
+    __m512i agree =
+      _mm512_add_epi32(_mm512_add_epi32(_mm512_maskz_set1_epi32(
+					  _mm512_cmpeq_epi32_mask(N, C), -1),
+					_mm512_maskz_set1_epi32(
+					  _mm512_cmpeq_epi32_mask(S, C), -1)),
+		       _mm512_add_epi32(_mm512_maskz_set1_epi32(
+					  _mm512_cmpeq_epi32_mask(W, C), -1),
+					_mm512_maskz_set1_epi32(
+					  _mm512_cmpeq_epi32_mask(E, C), -1)));
+    __m512i di = _mm512_add_epi32(eight, _mm512_add_epi32(agree, agree));
+    __m512 bestE =
+      _mm512_add_ps(_mm512_i32gather_ps(_mm512_add_epi32(base, C),
+					a.singletons32, 4),
+		    _mm512_i32gather_ps(di, a.doubletons32, 4));
+    __m512i best = C;
+    for (int r=0; r<a.no_regions; ++r)
+      {
+	__m512i vr = _mm512_set1_epi32(r);
+	agree =
+	  _mm512_add_epi32(_mm512_add_epi32(_mm512_maskz_set1_epi32(
+					      _mm512_cmpeq_epi32_mask(N, vr), -1),
+					    _mm512_maskz_set1_epi32(
+					      _mm512_cmpeq_epi32_mask(S, vr), -1)),
+			   _mm512_add_epi32(_mm512_maskz_set1_epi32(
+					      _mm512_cmpeq_epi32_mask(W, vr), -1),
+					    _mm512_maskz_set1_epi32(
+					      _mm512_cmpeq_epi32_mask(E, vr), -1)));
+	di = _mm512_add_epi32(eight, _mm512_add_epi32(agree, agree));
+	__m512 e =
+	  _mm512_add_ps(_mm512_i32gather_ps(_mm512_add_epi32(base, vr),
+					    a.singletons32, 4),
+			_mm512_i32gather_ps(di, a.doubletons32, 4));
+	__mmask16 less = _mm512_cmp_ps_mask(e, bestE, _CMP_LT_OQ);
+	bestE = _mm512_mask_blend_ps(less, bestE, e);
+	best = _mm512_mask_blend_epi32(less, best, vr);
+      }
+    __mmask16 diff = _mm512_cmpneq_epi32_mask(best, C);
+    changed += __builtin_popcount(diff);
+    _mm512_storeu_si512(out, best);
+    StoreLabels(a, i, j, out, diff, dE);
+  })
+}
+
+
+__attribute__((target("avx512f,avx512bw,avx2")))
+static int ICMAVX512Fixed(const ICMArgs &a, int i0, int i1, int color)
+{
+  const __m512i vL = _mm512_set1_epi32(a.no_regions);
+  const __m512i beta2 = _mm512_set1_epi16(2*a.doubletons16[5]);
+  const __m512i beta4 = _mm512_set1_epi16(a.doubletons16[8]);
+  const int ls = a.label_stride;
+  short out[32];
+
+#define EVENS32(q) _mm256_inserti128_si256(_mm256_castsi128_si256(Evens(q)), \
+					  Evens((q)+32), 1)
+  REDUCED_ROWS(short, int, 32, {
+    __m512i W = _mm512_cvtepu8_epi16(EVENS32(p-1));
+    __m512i C = _mm512_cvtepu8_epi16(EVENS32(p));
+    __m512i E = _mm512_cvtepu8_epi16(EVENS32(p+1));
+    __m512i N = _mm512_cvtepu8_epi16(EVENS32(p-ls));
+    __m512i S = _mm512_cvtepu8_epi16(EVENS32(p+ls));
+    __m512i base0 = _mm512_mullo_epi32(_mm512_cvtepu8_epi32(Evens(img)), vL);
+    __m512i base1 = _mm512_mullo_epi32(_mm512_cvtepu8_epi32(Evens(img+32)),
+				       vL);
+    __m512i bestE = C, best = C;
+    for (int r=-1; r<a.no_regions; ++r)	// r=-1: the current label
+      {
+	__m512i vr = (r < 0 ? C : _mm512_set1_epi16(r));
+	__m512i idx0 = _mm512_add_epi32(base0, r < 0 ?
+				      _mm512_cvtepu16_epi32(_mm512_castsi512_si256(C)) :
+				      _mm512_set1_epi32(r));
+	__m512i idx1 = _mm512_add_epi32(base1, r < 0 ?
+				      _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(C, 1)) :
+				      _mm512_set1_epi32(r));
+	// low 16 bits of the 32 bit gathers
+	__m512i s = _mm512_inserti64x4(
+	  _mm512_castsi256_si512(_mm512_cvtepi32_epi16(
+				   _mm512_i32gather_epi32(idx0, a.singletons16, 2))),
+	  _mm512_cvtepi32_epi16(_mm512_i32gather_epi32(idx1, a.singletons16, 2)),
+	  1);
+	// agree is minus the number of agreeing neighbours
+	__m512i agree =
+	  _mm512_add_epi16(_mm512_add_epi16(_mm512_movm_epi16(
+					      _mm512_cmpeq_epi16_mask(N, vr)),
+					    _mm512_movm_epi16(
+					      _mm512_cmpeq_epi16_mask(S, vr))),
+			   _mm512_add_epi16(_mm512_movm_epi16(
+					      _mm512_cmpeq_epi16_mask(W, vr)),
+					    _mm512_movm_epi16(
+					      _mm512_cmpeq_epi16_mask(E, vr))));
+	__m512i e = _mm512_add_epi16(s, _mm512_add_epi16(
+				       beta4, _mm512_mullo_epi16(agree, beta2)));
+	if (r < 0)
+	  bestE = e;
+	else
+	  {
+	    __mmask32 less = _mm512_cmpgt_epi16_mask(bestE, e);
+	    bestE = _mm512_mask_blend_epi16(less, bestE, e);
+	    best = _mm512_mask_blend_epi16(less, best, vr);
+	  }
+      }
+    __mmask32 diff = _mm512_cmpneq_epi16_mask(best, C);
+    changed += __builtin_popcount(diff);
+    _mm512_storeu_si512(out, best);
+    StoreLabels(a, i, j, out, diff, dE);
+  })
+#undef EVENS32
+}
+
+#endif
+
+
+ICMKernel SelectICMKernel(bool simd, int precision, const char **name)
+{
+  const char *dummy;
+  if (name == NULL) name = &dummy;
+#ifdef ICM_X86
+  if (simd)
+    {
+      __builtin_cpu_init();
+      bool avx2 = __builtin_cpu_supports("avx2");
+      bool avx512 = avx2 && __builtin_cpu_supports("avx512f");
+      switch (precision)
+	{
+	case ICM_FLOAT64:
+	  if (avx512)
+	    {
+	      *name = "avx512";
+	      return ICMAVX512;
+	    }
+	  if (avx2)
+	    {
+	      *name = "avx2";
+	      return ICMAVX2;
+	    }
+	  break;
+	case ICM_FLOAT32:
+	  if (avx512)
+	    {
+	      *name = "avx512-float";
+	      return ICMAVX512Float;
+	    }
+	  if (avx2)
+	    {
+	      *name = "avx2-float";
+	      return ICMAVX2Float;
+	    }
+	  break;
+	case ICM_FIXED16:
+	  if (avx512 && __builtin_cpu_supports("avx512bw"))
+	    {
+	      *name = "avx512-fixed";
+	      return ICMAVX512Fixed;
+	    }
+	  if (avx2)
+	    {
+	      *name = "avx2-fixed";
+	      return ICMAVX2Fixed;
+	    }
+	  break;
+	}
+    }
+#endif
+  switch (precision)
+    {
+    case ICM_FLOAT32:
+      *name = "scalar-float";
+      return ICMScalarReduced<float, float>;
+    case ICM_FIXED16:
+      *name = "scalar-fixed";
+      return ICMScalarReduced<short, int>;
+    }
+  *name = "scalar";
+  return ICMScalar;
+}
@@ -0,0 +1,77 @@
+/******************************************************************
+ * Modul name : icmsimd.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Vectorized kernels of the checkerboard ICM. A kernel updates the
+ * sites of one color of the checkerboard in a band of rows: each site
+ * gets the label of minimal local energy, the current label being
+ * kept on ties. Since sites of the same color are independent, the
+ * AVX2 kernel handles 4 and the AVX-512 kernel 8 sites of a row at
+ * once. All kernels compute the energies with the same floating
+ * point operations, hence they give the same labeling.
+ *
+ * The reduced precision kernels compare the local energies in single
+ * precision (8 resp. 16 sites at once) or in 16 bit fixed point (16
+ * resp. 32 sites at once). Their decisions may differ from the double
+ * precision ones at near ties; the energy changes are still computed
+ * in double precision.
+ *
+ *****************************************************************/
+
+#ifndef ICMSIMD_H
+#define ICMSIMD_H
+
+#include "imagebuffer.h"
+
+
+/* Everything a kernel needs to know about the image and the model
+ */
+struct ICMArgs
+{
+  label_t *labels;		  // labeling (updated in place)
+  int label_stride;
+  const unsigned char *image;	  // input intensities
+  int image_stride;
+  int width, height;
+  int no_regions;
+  const double *singletons;	  // [intensity*no_regions + label]
+  const double *doubletons;	  // [k+4] = beta*k, k=-4..4 is the
+				  // number of disagreeing minus the
+				  // number of agreeing neighbours
+  double *row_dE;		  // [i] += change of the energy in row i
+
+  /* tables of the reduced precision kernels (see MRFEngine::
+   * InitReduced()): the singletons relative to the smallest one of
+   * each intensity, and the doubletons in the same units
+   */
+  const float *singletons32;
+  const float *doubletons32;
+  const short *singletons16;	  // (readable one entry beyond the end)
+  const short *doubletons16;
+};
+
+enum { ICM_FLOAT64, ICM_FLOAT32, ICM_FIXED16 }; // precision of a kernel
+
+/* Updates the sites (i,j) with (i+j)%2 == color in rows [i0,i1).
+ * Returns the number of changed labels. The energy changes of a row
+ * are summed up in the order of the sites in every kernel, so the
+ * sums are also identical.
+ */
+typedef int (*ICMKernel)(const ICMArgs &a, int i0, int i1, int color);
+
+/* Returns the fastest kernel of the given precision supported by the
+ * CPU, or the scalar one if simd is false. name (if not NULL) is set
+ * to the kernel's name.
+ */
+ICMKernel SelectICMKernel(bool simd, int precision=ICM_FLOAT64,
+			  const char **name=NULL);
+
+/* Writes the labels the double precision kernels would give to the
+ * sites of one color in rows [i0,i1) to out (same layout as the
+ * labeling) without changing the labeling.
+ */
+void ICMReference(const ICMArgs &a, int i0, int i1, int color,
+		  label_t *out, int out_stride);
+
+
+#endif
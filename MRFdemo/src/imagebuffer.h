@@ -0,0 +1,126 @@
+/******************************************************************
+ * Modul name : imagebuffer.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Contiguous, cache line aligned 2D buffer of pixels. Rows are
+ * padded to a multiple of the cache line size, so the vertical
+ * neighbour of a pixel is always at a fixed distance (the stride).
+ * Resizing keeps the allocated memory whenever it is large enough,
+ * hence a buffer can be reused for several runs without
+ * reallocation.
+ *
+ *****************************************************************/
+
+#ifndef IMAGEBUFFER_H
+#define IMAGEBUFFER_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#define CACHE_LINE 64		// alignment of buffers and rows (bytes)
+
+
+/* Label type of the segmentations. Compile with -DMRF_WIDE_LABELS if
+ * more than 256 classes are needed.
+ */
+#ifdef MRF_WIDE_LABELS
+typedef unsigned short label_t;
+#define MRF_MAX_REGIONS 65536
+#else
+typedef unsigned char label_t;
+#define MRF_MAX_REGIONS 256
+#endif
+
+
+inline void *AlignedAlloc(size_t size)
+{
+#ifdef _WIN32
+  return _aligned_malloc(size, CACHE_LINE);
+#else
+  void *p;
+  return (posix_memalign(&p, CACHE_LINE, size) == 0 ? p : NULL);
+#endif
+}
+
+
+inline void AlignedFree(void *p)
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+
+template <class T>
+class ImageBuffer
+{
+public:
+  ImageBuffer() { data = NULL; width = height = stride = 0; capacity = 0; }
+  ~ImageBuffer() { AlignedFree(data); }
+
+  /* Sets the size of the buffer. The content is undefined afterwards.
+   * Memory is reallocated only if the buffer has to grow.
+   */
+  void Resize(int w, int h)
+  {
+    int per_line = CACHE_LINE / sizeof(T);
+    stride = (w + per_line - 1) / per_line * per_line;
+    size_t size = (size_t)stride * h * sizeof(T);
+    if (size > capacity)
+      {
+	AlignedFree(data);
+	data = (T *)AlignedAlloc(size);
+	capacity = size;
+      }
+    width = w;
+    height = h;
+  }
+  void Clear() { width = height = 0; } // empty, but keeps the memory
+  void Copy(ImageBuffer &src)	// resizes to src and copies its pixels
+  {
+    Resize(src.GetWidth(), src.GetHeight());
+    for (int i=0; i<height; ++i)
+      memcpy(Row(i), src.Row(i), width*sizeof(T));
+  }
+  void Swap(ImageBuffer &b)	// exchanges the contents of two buffers
+  {
+    T *d = data; data = b.data; b.data = d;
+    int n = width; width = b.width; b.width = n;
+    n = height; height = b.height; b.height = n;
+    n = stride; stride = b.stride; b.stride = n;
+    size_t c = capacity; capacity = b.capacity; b.capacity = c;
+  }
+  void Fill(T value)
+  {
+    for (int i=0; i<height; ++i)
+      for (int j=0; j<width; ++j)
+	Row(i)[j] = value;
+  }
+
+  bool IsEmpty() { return width == 0 || height == 0; }
+  int GetWidth() { return width; }
+  int GetHeight() { return height; }
+  int GetStride() { return stride; }	// distance of rows (in pixels)
+  size_t GetBytes() { return capacity; } // allocated memory
+
+  T *Row(int i) { return data + (size_t)i*stride; }
+  T &operator()(int i, int j) { return data[(size_t)i*stride + j]; }
+
+private:
+  T *data;
+  int width, height;
+  int stride;
+  size_t capacity;		// allocated bytes
+
+  ImageBuffer(const ImageBuffer &);	       // not copyable
+  ImageBuffer &operator=(const ImageBuffer &);
+};
+
+
+#endif
@@ -0,0 +1,321 @@
+/******************************************************************
+ * Modul name : maxflow.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Boykov-Kolmogorov max-flow on a 4-connected grid (see maxflow.h).
+ * Two search trees are grown from the source and the sink along
+ * non-saturated edges. When they touch, the flow is augmented along
+ * the path found, which turns the nodes below saturated edges into
+ * orphans; these are either adopted by another node of their tree or
+ * become free. The algorithm stops when no tree can grow any more.
+ *
+ *****************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "maxflow.h"
+
+#define INFINITE_D 1000000000	// distance of nodes not connected to a
+				// terminal
+
+
+GridMaxflow::GridMaxflow()
+{
+  width = height = n = 0;
+  tr_cap = edge_cap = NULL;
+  neighbours = parent = is_sink = in_queue = NULL;
+  ts = dist = active = orphans = NULL;
+}
+
+
+GridMaxflow::~GridMaxflow()
+{
+  Free();
+}
+
+
+void GridMaxflow::Free()
+{
+  delete [] tr_cap;
+  delete [] edge_cap;
+  delete [] neighbours;
+  delete [] parent;
+  delete [] is_sink;
+  delete [] in_queue;
+  delete [] ts;
+  delete [] dist;
+  delete [] active;
+  delete [] orphans;
+}
+
+
+void GridMaxflow::Init(int w, int h)
+{
+  int i, j;
+
+  if (w*h != n)
+    {
+      Free();
+      n = w*h;
+      tr_cap = new double[n];
+      edge_cap = new double[4*n];
+      neighbours = new unsigned char[n];
+      parent = new unsigned char[n];
+      is_sink = new unsigned char[n];
+      in_queue = new unsigned char[n];
+      ts = new int[n];
+      dist = new int[n];
+      active = new int[n+1];	// a node is queued at most once
+      orphans = new int[n+1];
+    }
+  width = w;
+  height = h;
+  offset[EAST] = 1;
+  offset[SOUTH] = w;
+  offset[WEST] = -1;
+  offset[NORTH] = -w;
+  memset(tr_cap, 0, n*sizeof(double));
+  memset(edge_cap, 0, 4*n*sizeof(double));
+  for (i=0; i<h; ++i)
+    for (j=0; j<w; ++j)
+      neighbours[i*w+j] = (j < w-1) << EAST | (i < h-1) << SOUTH |
+	(j > 0) << WEST | (i > 0) << NORTH;
+}
+
+
+int GridMaxflow::NextActive()
+{
+  while (active_first != active_last)
+    {
+      int p = active[active_first];
+      if (++active_first > n) active_first = 0;
+      in_queue[p] = 0;
+      if (parent[p] != FREE) return p;
+    }
+  return -1;
+}
+
+
+/* Pushes the bottleneck capacity through the path
+ * s -> ... -> a -> b -> ... -> t, where a is in the source tree, b in
+ * the sink tree and b is the neighbour of a in direction dir. Nodes
+ * whose edge to the parent gets saturated become orphans.
+ */
+double GridMaxflow::Augment(int a, int b, int dir)
+{
+  int p, q, d;
+  double f = edge_cap[4*a+dir];
+
+  /* find the bottleneck
+   */
+  for (p=a; parent[p]!=TERMINAL; p=q)
+    {
+      d = parent[p];
+      q = p + offset[d];
+      if (edge_cap[4*q+((d+2)&3)] < f) f = edge_cap[4*q+((d+2)&3)];
+    }
+  if (tr_cap[p] < f) f = tr_cap[p];
+  for (p=b; parent[p]!=TERMINAL; p=q)
+    {
+      d = parent[p];
+      q = p + offset[d];
+      if (edge_cap[4*p+d] < f) f = edge_cap[4*p+d];
+    }
+  if (-tr_cap[p] < f) f = -tr_cap[p];
+
+  /* augment
+   */
+  edge_cap[4*a+dir] -= f;
+  edge_cap[4*b+((dir+2)&3)] += f;
+  for (p=a; parent[p]!=TERMINAL; p=q)
+    {
+      d = parent[p];
+      q = p + offset[d];
+      edge_cap[4*p+d] += f;
+      if ((edge_cap[4*q+((d+2)&3)] -= f) == 0) SetOrphan(p);
+    }
+  if ((tr_cap[p] -= f) == 0) SetOrphan(p);
+  for (p=b; parent[p]!=TERMINAL; p=q)
+    {
+      d = parent[p];
+      q = p + offset[d];
+      edge_cap[4*q+((d+2)&3)] += f;
+      if ((edge_cap[4*p+d] -= f) == 0) SetOrphan(p);
+    }
+  if ((tr_cap[p] += f) == 0) SetOrphan(p);
+  return f;
+}
+
+
+/* Looks for a new parent of orphan p in its tree: a neighbour with a
+ * non-saturated edge towards p (away from p in the sink tree) whose
+ * path leads to the terminal. The closest one is taken. If there is
+ * none, p becomes free and its children become orphans.
+ */
+void GridMaxflow::Adopt(int p)
+{
+  int d, q, r, k;
+  int best = -1, d_min = INFINITE_D;
+  bool sink = is_sink[p];
+
+  for (d=0; d<4; ++d)
+    {
+      if (!(neighbours[p] >> d & 1)) continue;
+      q = p + offset[d];
+      if (parent[q] == FREE || is_sink[q] != sink) continue;
+      if (sink ? edge_cap[4*p+d] <= 0 : edge_cap[4*q+((d+2)&3)] <= 0)
+	continue;
+      /* check the origin of q
+       */
+      for (k=0, r=q; ; r+=offset[parent[r]])
+	{
+	  if (ts[r] == time)
+	    {
+	      k += dist[r];
+	      break;
+	    }
+	  ++k;
+	  if (parent[r] == TERMINAL)
+	    {
+	      ts[r] = time;
+	      dist[r] = 1;
+	      break;
+	    }
+	  if (parent[r] == ORPHAN)
+	    {
+	      k = INFINITE_D;
+	      break;
+	    }
+	}
+      if (k < INFINITE_D)
+	{
+	  if (k < d_min)
+	    {
+	      best = d;
+	      d_min = k;
+	    }
+	  /* set marks along the path
+	   */
+	  for (r=q; ts[r]!=time; r+=offset[parent[r]])
+	    {
+	      ts[r] = time;
+	      dist[r] = k--;
+	    }
+	}
+    }
+
+  if (best >= 0)
+    {
+      parent[p] = best;
+      ts[p] = time;
+      dist[p] = d_min + 1;
+      return;
+    }
+
+  /* no parent found: p becomes free
+   */
+  for (d=0; d<4; ++d)
+    {
+      if (!(neighbours[p] >> d & 1)) continue;
+      q = p + offset[d];
+      if (parent[q] == FREE || is_sink[q] != sink) continue;
+      if (sink ? edge_cap[4*p+d] > 0 : edge_cap[4*q+((d+2)&3)] > 0)
+	SetActive(q);
+      if (parent[q] != TERMINAL && parent[q] != ORPHAN &&
+	  q + offset[parent[q]] == p)
+	SetOrphan(q);
+    }
+  parent[p] = FREE;
+}
+
+
+double GridMaxflow::Maxflow()
+{
+  int p, q, d;
+  int a, b, dir;
+  double flow = 0.0;
+
+  active_first = active_last = 0;
+  orphan_first = orphan_last = 0;
+  time = 0;
+  for (p=0; p<n; ++p)
+    {
+      in_queue[p] = 0;
+      if (tr_cap[p] != 0)
+	{
+	  parent[p] = TERMINAL;
+	  is_sink[p] = (tr_cap[p] < 0);
+	  ts[p] = 0;
+	  dist[p] = 1;
+	  SetActive(p);
+	}
+      else
+	parent[p] = FREE;
+    }
+
+  p = -1;		// node being grown
+  while (true)
+    {
+      if (p < 0 || parent[p] == FREE)
+	if ((p = NextActive()) < 0) break;
+
+      /* grow the tree of p until it touches the other tree
+       */
+      a = -1;
+      for (d=0; d<4; ++d)
+	{
+	  if (!(neighbours[p] >> d & 1)) continue;
+	  q = p + offset[d];
+	  if (is_sink[p] ? edge_cap[4*q+((d+2)&3)] <= 0 : edge_cap[4*p+d] <= 0)
+	    continue;
+	  if (parent[q] == FREE)
+	    {
+	      is_sink[q] = is_sink[p];
+	      parent[q] = (d+2)&3;
+	      ts[q] = ts[p];
+	      dist[q] = dist[p] + 1;
+	      SetActive(q);
+	    }
+	  else if (is_sink[q] != is_sink[p])
+	    {
+	      if (is_sink[p])
+		{
+		  a = q;
+		  b = p;
+		  dir = (d+2)&3;
+		}
+	      else
+		{
+		  a = p;
+		  b = q;
+		  dir = d;
+		}
+	      break;
+	    }
+	  else if (ts[q] <= ts[p] && dist[q] > dist[p])
+	    {
+	      /* heuristic: make paths shorter
+	       */
+	      parent[q] = (d+2)&3;
+	      ts[q] = ts[p];
+	      dist[q] = dist[p] + 1;
+	    }
+	}
+      if (a < 0)
+	{
+	  p = -1;	// p can't grow any more
+	  continue;
+	}
+
+      ++time;
+      flow += Augment(a, b, dir);
+      while (orphan_first != orphan_last)
+	{
+	  q = orphans[orphan_first];
+	  if (++orphan_first > n) orphan_first = 0;
+	  Adopt(q);
+	}
+    }
+  return flow;
+}
@@ -0,0 +1,94 @@
+/******************************************************************
+ * Modul name : maxflow.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Minimum s-t cut of a 4-connected grid graph, computed with the
+ * augmenting path algorithm of Y. Boykov and V. Kolmogorov: An
+ * Experimental Comparison of Min-Cut/Max-Flow Algorithms for Energy
+ * Minimization in Vision. IEEE Trans. PAMI 26(9), 2004.
+ *
+ * The nodes are the pixels. Unlike a general graph there are no
+ * adjacency lists: the neighbours of a node are found by index
+ * arithmetic and each node stores the residual capacities of its
+ * four outgoing edges next to each other, so a search step touches
+ * only a few cache lines.
+ *
+ *****************************************************************/
+
+#ifndef MAXFLOW_H
+#define MAXFLOW_H
+
+
+class GridMaxflow
+{
+public:
+  enum { EAST, SOUTH, WEST, NORTH };	// edge directions
+
+  GridMaxflow();
+  ~GridMaxflow();
+
+  void Init(int w, int h);		// w*h nodes (p = i*w+j), no
+					// edges. Memory is reused.
+  void AddTerminal(int p, double source, double sink)
+  {					// capacities of s->p and p->t
+    tr_cap[p] += source - sink;
+  }
+  void AddEdge(int p, int dir,		// capacities of the edge from p
+	       double cap, double rev_cap) // to its neighbour in direction
+  {					// dir and of the reverse edge
+    edge_cap[4*p+dir] += cap;
+    edge_cap[4*(p+offset[dir])+((dir+2)&3)] += rev_cap;
+  }
+  double Maxflow();			// returns the value of the flow
+  bool IsSink(int p)			// true if p is on the sink side
+  {					// of the minimum cut
+    return parent[p] != FREE && is_sink[p];
+  }
+
+private:
+  enum { TERMINAL=4, ORPHAN, FREE };	// special values of parent[]
+
+  int width, height, n;
+  int offset[4];			// index offsets of the neighbours
+  double *tr_cap;			// >0: residual capacity of s->p,
+					// <0: minus that of p->t
+  double *edge_cap;			// [4*p+dir]: residual capacities
+  unsigned char *neighbours;		// bit dir set if p has a
+					// neighbour in direction dir
+  unsigned char *parent;		// direction of the parent in the
+					// search tree or TERMINAL, ORPHAN
+					// or FREE (not in a tree)
+  unsigned char *is_sink;		// tree of p (if not FREE)
+  unsigned char *in_queue;		// p is in the active queue
+  int *ts, *dist;			// time stamp and distance to the
+					// terminal (adoption heuristics)
+  int *active, active_first, active_last; // FIFO of active nodes
+  int *orphans, orphan_first, orphan_last; // FIFO of orphans
+  int time;
+
+  void Free();				// frees the memory
+  void SetActive(int p)
+  {
+    if (!in_queue[p])
+      {
+	in_queue[p] = 1;
+	active[active_last] = p;
+	if (++active_last > n) active_last = 0;
+      }
+  }
+  int NextActive();			// -1 if there are none
+  void SetOrphan(int p)
+  {
+    parent[p] = ORPHAN;
+    orphans[orphan_last] = p;
+    if (++orphan_last > n) orphan_last = 0;
+  }
+  double Augment(int a, int b, int dir); // along s->..a->b..->t
+  void Adopt(int p);			// finds a new parent for an orphan
+
+  GridMaxflow(const GridMaxflow &);	// not copyable
+  GridMaxflow &operator=(const GridMaxflow &);
+};
+
+
+#endif
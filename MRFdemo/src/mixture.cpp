@@ -0,0 +1,176 @@
+/******************************************************************
+ * Modul name : mixture.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Gaussian mixture of a 256 bin histogram (see mixture.h).
+ *
+ *****************************************************************/
+
+#include <math.h>
+
+#include "mixture.h"
+
+
+GaussianMixture::GaussianMixture(int _n)
+{
+  n = _n;
+  mean = new double[n];
+  variance = new double[n];
+  weight = new double[n];
+  for (int k=0; k<n; ++k)
+    {
+      mean[k] = 0.0;
+      variance[k] = MIXTURE_MIN_VARIANCE;
+      weight[k] = 1.0/n;
+    }
+  log_likelihood = 0.0;
+}
+
+
+GaussianMixture::~GaussianMixture()
+{
+  delete [] mean;
+  delete [] variance;
+  delete [] weight;
+}
+
+
+/* The k-th center starts at the (k+1/2)/n quantile of the intensities.
+ * In one dimension the centers stay ordered, so the bins of a class are
+ * an interval and the assignment is a single scan over the bins.
+ */
+void GaussianMixture::KMeans(const double *h)
+{
+  double *s0 = new double[n], *s1 = new double[n], *s2 = new double[n];
+  double total = 0.0, cum = 0.0;
+  int g, k, it;
+
+  for (g=0; g<256; ++g) total += h[g];
+  for (g=0, k=0; g<256 && k<n; ++g)
+    {
+      cum += h[g];
+      while (k < n && cum >= (k+0.5)/n*total) mean[k++] = g;
+    }
+  while (k < n) mean[k++] = 255;
+  for (k=1; k<n; ++k)		// distinct centers
+    if (mean[k] <= mean[k-1]) mean[k] = mean[k-1] + 1.0;
+
+  for (it=0; it<100; ++it)
+    {
+      for (k=0; k<n; ++k) s0[k] = s1[k] = s2[k] = 0.0;
+      for (g=0, k=0; g<256; ++g)
+	{
+	  while (k < n-1 && g - mean[k] > mean[k+1] - g) ++k;
+	  s0[k] += h[g];
+	  s1[k] += h[g]*g;
+	  s2[k] += h[g]*g*g;
+	}
+      bool moved = false;
+      for (k=0; k<n; ++k)
+	if (s0[k] > 0.0 && s1[k]/s0[k] != mean[k])
+	  {
+	    mean[k] = s1[k]/s0[k];
+	    moved = true;
+	  }
+      if (!moved) break;
+    }
+
+  for (k=0; k<n; ++k)
+    {
+      variance[k] = (s0[k] > 0.0 ?
+		     s2[k]/s0[k] - mean[k]*mean[k] : MIXTURE_MIN_VARIANCE);
+      if (variance[k] < MIXTURE_MIN_VARIANCE)
+	variance[k] = MIXTURE_MIN_VARIANCE;
+      weight[k] = (total > 0.0 ? s0[k]/total : 1.0/n);
+    }
+  delete [] s0;
+  delete [] s1;
+  delete [] s2;
+}
+
+
+/* E-step: the responsibilities of the classes for each intensity,
+ * computed in the log domain (a far class underflows otherwise) and
+ * weighted by the count of the bin. M-step: the weighted moments of the
+ * classes. A class which lost all its pixels keeps its parameters.
+ */
+int GaussianMixture::EM(const double *h, int max_iterations, double tol)
+{
+  double *s0 = new double[n], *s1 = new double[n], *s2 = new double[n];
+  double *c = new double[n], *p = new double[n];
+  double total = 0.0, previous = 0.0;
+  int g, k, it;
+
+  for (g=0; g<256; ++g) total += h[g];
+  if (total <= 0.0) max_iterations = 0;
+  for (it=0; it<max_iterations; ++it)
+    {
+      for (k=0; k<n; ++k)
+	{
+	  s0[k] = s1[k] = s2[k] = 0.0;
+	  c[k] = log(weight[k]) -
+	    0.5*log(2.0*3.141592653589793*variance[k]);
+	}
+      double ll = 0.0;
+      for (g=0; g<256; ++g)
+	{
+	  if (h[g] <= 0.0) continue;
+	  double top = -HUGE_VAL, sum = 0.0;
+	  for (k=0; k<n; ++k)
+	    {
+	      double d = g - mean[k];
+	      p[k] = c[k] - d*d/(2.0*variance[k]);
+	      if (p[k] > top) top = p[k];
+	    }
+	  for (k=0; k<n; ++k)
+	    {
+	      p[k] = exp(p[k] - top);
+	      sum += p[k];
+	    }
+	  ll += h[g]*(top + log(sum));
+	  for (k=0; k<n; ++k)
+	    {
+	      double r = h[g]*p[k]/sum;
+	      s0[k] += r;
+	      s1[k] += r*g;
+	      s2[k] += r*g*g;
+	    }
+	}
+      ll /= total;
+
+      for (k=0; k<n; ++k)
+	if (s0[k] > 1e-9*total)
+	  {
+	    weight[k] = s0[k]/total;
+	    mean[k] = s1[k]/s0[k];
+	    variance[k] = s2[k]/s0[k] - mean[k]*mean[k];
+	    if (variance[k] < MIXTURE_MIN_VARIANCE)
+	      variance[k] = MIXTURE_MIN_VARIANCE;
+	  }
+      log_likelihood = ll;
+      if (it > 0 && ll - previous < tol*fabs(ll)) { ++it; break; }
+      previous = ll;
+    }
+  delete [] s0;
+  delete [] s1;
+  delete [] s2;
+  delete [] c;
+  delete [] p;
+  return it;
+}
+
+
+void GaussianMixture::Sort()
+{
+  for (int k=1; k<n; ++k)
+    for (int l=k; l>0 && mean[l] < mean[l-1]; --l)
+      {
+	double m = mean[l], v = variance[l], w = weight[l];
+	mean[l] = mean[l-1];
+	variance[l] = variance[l-1];
+	weight[l] = weight[l-1];
+	mean[l-1] = m;
+	variance[l-1] = v;
+	weight[l-1] = w;
+      }
+}
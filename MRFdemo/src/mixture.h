@@ -0,0 +1,51 @@
+/******************************************************************
+ * Modul name : mixture.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Gaussian mixture of the intensities of a gray level image, fitted
+ * to its 256 bin histogram: k-means gives the initial classes and EM
+ * refines them. Every step is a loop over the bins weighted by their
+ * counts, hence the cost does not depend on the image size. Used by
+ * MRFEngine::EstimateClasses() for unsupervised segmentation.
+ *
+ *****************************************************************/
+
+#ifndef MIXTURE_H
+#define MIXTURE_H
+
+#define MIXTURE_MIN_VARIANCE 1.0	// a class narrower than one gray
+					// level would swallow its bin
+
+
+class GaussianMixture
+{
+public:
+  GaussianMixture(int n);		// n classes
+  ~GaussianMixture();
+
+  void KMeans(const double *histogram); // seeds at the quantiles of the
+					// histogram, then Lloyd
+					// iterations
+  int EM(const double *histogram,	// refines the classes, stops
+	 int max_iterations=200,	// when the log-likelihood grows
+	 double tol=1e-7);		// by less than tol (relative).
+					// Returns the # of iterations
+  void Sort();				// orders the classes by mean
+
+  int GetNoClasses() { return n; }
+  double GetMean(int k) { return mean[k]; }
+  double GetVariance(int k) { return variance[k]; }
+  double GetWeight(int k) { return weight[k]; }
+  double GetLogLikelihood() { return log_likelihood; } // per pixel
+
+private:
+  int n;
+  double *mean, *variance, *weight;
+  double log_likelihood;
+
+  GaussianMixture(const GaussianMixture &); // not copyable
+  GaussianMixture &operator=(const GaussianMixture &);
+};
+
+
+#endif
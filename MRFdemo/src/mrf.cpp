@@ -5,7 +5,7 @@
  * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
  * Description:
  * Intensity-based image segmentation using a Markov random field
- * segmentation model and four different optimization algorithms:
+ * segmentation model and five different optimization algorithms:
  * Metropolis - Simulated Annealing using Metropolis dynamics
  * Gibbs      - Simulated Annealing using a Gibbs sampler
  * ICM        - Iterated Conditional Modes, a deterministic suboptimal
@@ -13,6 +13,9 @@
  * MMD        - Modified Metropolis Dynamics, a pseudo-stochastic
  *              suboptimal method which is less sensitive to
  *              initialization than ICM.
+ * Graph cut  - alpha-expansion moves computed as minimum cuts, a
+ *              deterministic method reaching low energies in a few
+ *              iterations.
  *
  * The program GUI is written in wxWindows hence the code can be
  * compiled and ran under Windows as well as under Linux/Unix.
@@ -63,24 +66,20 @@ static char rcsid_mrf_cpp[]="$Id: mrf.cpp,v 1.8 2009/01/08 15:30:47 kato Exp $";
 #include <math.h>
 #include <stdlib.h>
 
-/* Random number generators
- */
-#include "randomc.h"   // define classes for random number generators
-
 /* Timer classes
  */
 #include "CKProcessTimeCounter.h"
 
+/* Segmentation engine
+ */
+#include "mrfengine.h"
+
 #define WINDOW_TITLE "MRF Image Segmentation Demo $Revision: 1.8 $"
 #define VERSION      "MRF Image Segmentation Demo $Revision: 1.8 $ (Last built "\
                      __DATE__" "__TIME__") "
 #define COPYRIGHT    "(c) 2004 by Csaba Gradwohl & Zoltan Kato (SZTE - Hungary)"
 
 
-static wxTextCtrl *gaussians;            // output textfield for Gaussian parameters
-static CKProcessTimeCounter timer("core"); // CPU timer
-static bool timer_valid = FALSE;
-
 /* Program's application class 
  */
 class MyApp: public wxApp
@@ -90,76 +89,35 @@ class MyApp: public wxApp
 
 
 /* ImageOperations class: it handles all image operations such as
- * loading, saving, etc... 
+ * loading, saving, etc... The segmentation itself is done by the
+ * MRFEngine base class.
  */
-class ImageOperations
+class ImageOperations: public MRFEngine
 {
 public:
   ImageOperations(wxWindow *_frame);    // constructor
   wxImage *LoadBmp(wxString bmp_name);	// loads an image from file		
   bool SaveBmp(wxString bmp_name);      // saves out_image to a given file
   bool IsOutput();			// TRUE if  out_image <> NULL
-  void SetNoRegions(int n);	      	// sets the number of regions,
-					// allocates/frees memory for
-					// means and variances
-  int GetNoRegions() { return no_regions; }
-  void SetBeta(double b) { beta = b; }
-  void SetT(double x) { t = x; }
-  void SetT0(double t) { T0 = t; }
-  void SetC(double x) { c = x; }
-  void SetAlpha(double x) { alpha = x; }
-  int GetK() { return K; }
-  double GetT() { return T; }
-  double GetE() { return E; }
   double GetTimer() { return (timer_valid? timer.GetElapsedTimeMs() : 0.0); }
+  void StartTimer();			// starts timing an optimization
+  void StopTimer();
 
   void CalculateMeanAndVariance(int region);  // computes mean and
 					      // variance of the given region.
-  double CalculateEnergy();                   // computes global energy
-					      // based on the current
-					      // lableing in data
-  double LocalEnergy(int i, int j, int label);// computes the local
-					      // energy at site (i,j)
-					      // assuming "label" has
-					      // been assigned to it.
-
-  void Metropolis(bool mmd=false);  // executes Metropolis or MMD (if mmd=true)
-  void ICM();			    // executes ICM
-  void Gibbs();			    // executes Gibbs sampler
+
+protected:
+  virtual void OnIteration() { CreateOutput(); }
 
 private:
   wxWindow *frame;		    // the main window
   wxImage *in_image, *out_image;    // input & output images
-  int width, height;		    // width and height of the
-				    // displayed image
-  int no_regions;	            // number of regions for Gaussian
-				    // parameter computation
-  double beta;                      // strength of second order clique potential
-  double t;			    // Stop criteraia threshold: stop
-				    // if (deltaE < t)
-  double T0;		            // Initial temperature (not used by ICM)
-
-  double c;			    // Temperature scheduler's factor:
-				    // T(n+1)=c*T(n).
-  double alpha;		            // alpha value for MMD
-  double *mean;			    // computed mean values and
-  double *variance;		    // variances for each region
-  double E;			    // current global energy
-  double E_old;			    // global energy in the prvious iteration
-  double T;			    // current temperature
-  int K;			    // current iteration #
-  int **classes;		    // this is the labeled image
-  int **in_image_data;		    // Intensity values of the input image 
-
-  void InitOutImage();
+  CKProcessTimeCounter timer;	    // CPU timer
+  bool timer_valid;		    // timer holds the time of the last
+				    // optimization
+
   void CreateOutput();	           // creates and draws the output
 				   // image based on the current labeling
-  double Singleton(int i, int j, int label); // computes singleton
-					     // potential at site
-					     // (i,j) having a label "label"
-  double Doubleton(int i, int j, int label); // computes doubleton
-					     // potential at site
-					     // (i,j) having a label "label"
 };
 
 
@@ -217,6 +175,7 @@ public:
   }
   MyScrolledWindow *GetInputWindow() { return input_window; }
   MyScrolledWindow *GetOutputWindow() { return output_window; }
+  wxTextCtrl *GetGaussians() { return gaussians; }
   
   bool IsSelected(int region) { // tells whether the region has been selected 
     return (regs[region*4] || regs[region*4+1] || 
@@ -234,13 +193,18 @@ private:
 						     // images' window
   wxButton *load_button, *save_button, *doit_button; // buttons
   wxButton *select_region_button;
+  wxButton *estimate_button;	// estimates the classes without
+				// training rectangles
   wxChoice *op_choice;		// scroll-list of optimization algorithms
   wxTextCtrl *regions;          // input field for number of classes,
   wxTextCtrl *tbeta, *tt;	// beta, threshold t,
   wxTextCtrl *tT0, *tc;		// initial temperature T0, scheduler factor c,
+  wxCheckBox *adaptive;		// adaptive schedule (see AnnealingSchedule)
   wxTextCtrl *talpha;		// and MMD's alpha
+  wxTextCtrl *gaussians;	// output textfield for Gaussian parameters
   int act_region;   // the current class
   int *regs;	    // stores the training rectangles for each class.
+  bool estimated;   // the classes have been estimated (see OnEstimate)
   
   /* Event handlers
    */  
@@ -250,13 +214,15 @@ private:
   void OnChoice(wxCommandEvent& event);	      // optimization method selection 
   void OnRegions(wxCommandEvent& event);      // number of classes
   void OnSelectRegion(wxCommandEvent& event); // select training rectangle
+  void OnEstimate(wxCommandEvent& event);     // estimate classes
+  void ShowGaussians();			      // prints the class parameters
   void OnPaint(wxPaintEvent& event);	      // paint handler
   DECLARE_EVENT_TABLE()
     };
 
 enum { ID_LOAD_BUTTON, ID_SAVE_BUTTON, ID_DOIT_BUTTON, ID_CHOICE,
        ID_REGIONS, ID_SELECTREGION_BUTTON, ID_BETA, ID_T, ID_T0, ID_C,
-       ID_ALPHA, ID_GAUSSIANS };
+       ID_ALPHA, ID_GAUSSIANS, ID_ESTIMATE_BUTTON, ID_ADAPTIVE };
 
 /* Event table
  */
@@ -268,6 +234,7 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
   EVT_PAINT(MyFrame::OnPaint)
   EVT_TEXT(ID_REGIONS, MyFrame::OnRegions)
   EVT_BUTTON(ID_SELECTREGION_BUTTON, MyFrame::OnSelectRegion)
+  EVT_BUTTON(ID_ESTIMATE_BUTTON, MyFrame::OnEstimate)
 END_EVENT_TABLE()
 
 BEGIN_EVENT_TABLE(MyScrolledWindow, wxScrolledWindow)
@@ -396,7 +363,8 @@ void MyFrame::OnPaint(wxPaintEvent& event)
   pDC.DrawText(str, 190, 360);
   str.Printf("Class parameters:");
   pDC.DrawText(str, 20, 465);
-  if (op_choice->GetStringSelection() != "ICM") 
+  if (op_choice->GetStringSelection() != "ICM" &&
+      op_choice->GetStringSelection() != "Graph cut") 
     {
       str.Printf("T0 = ");
       pDC.DrawText(str, 35, 395);
@@ -447,9 +415,13 @@ MyFrame::MyFrame(const wxString& title, const wxPoint& pos, const wxSize& size)
   select_region_button = new wxButton(this, ID_SELECTREGION_BUTTON, 
 				      "Select classes", wxPoint(218,321));
   select_region_button->Disable();
-  wxString choices[4] = {"Metropolis", "Gibbs sampler", "ICM", "MMD"};
+  estimate_button = new wxButton(this, ID_ESTIMATE_BUTTON, "Estimate",
+				 wxPoint(330,321));
+  estimate_button->Disable();
+  wxString choices[5] = {"Metropolis", "Gibbs sampler", "ICM", "MMD",
+			 "Graph cut"};
   op_choice = new wxChoice(this, ID_CHOICE, wxPoint(346,80), wxDefaultSize, 
-			   4, choices);
+			   5, choices);
   op_choice->SetStringSelection("Metropolis");
 	
   regions = new wxTextCtrl(this, ID_REGIONS, "", wxPoint(152,321), 
@@ -483,6 +455,7 @@ MyFrame::MyFrame(const wxString& title, const wxPoint& pos, const wxSize& size)
   tc->SetMaxLength(8);
   // tc->SetValue("0.98");
   *tc << 0.98;
+  adaptive = new wxCheckBox(this, ID_ADAPTIVE, "adaptive", wxPoint(280,391));
   talpha = new wxTextCtrl(this, ID_ALPHA, "", wxPoint(67,426), 
 			 wxSize(60,20), wxTE_PROCESS_ENTER|wxTE_RIGHT, 
 			 *(new wxTextValidator(wxFILTER_NUMERIC)));
@@ -499,7 +472,7 @@ MyFrame::MyFrame(const wxString& title, const wxPoint& pos, const wxSize& size)
 
   regs = NULL;
   act_region = -1;
-
+  estimated = false;
 }
 
 
@@ -540,6 +513,8 @@ void MyFrame::OnOpen(wxCommandEvent& event)
 	      act_region = -1;
 	      imageop->SetNoRegions(-1);
 	    }
+	  estimated = false;
+	  if (regions->GetValue().Length() != 0) estimate_button->Enable();
 	  doit_button->Disable();
 	  Refresh();
 	}
@@ -585,7 +560,8 @@ void MyFrame::OnDoit(wxCommandEvent& event)
     }
   else	// TODO: check value!
     imageop->SetT(atof(t));
-  if (op_choice->GetStringSelection() != "ICM")
+  if (op_choice->GetStringSelection() != "ICM" &&
+      op_choice->GetStringSelection() != "Graph cut")
     {
       if ((T0=tT0->GetValue()).Length() == 0)	
 	{
@@ -601,6 +577,7 @@ void MyFrame::OnDoit(wxCommandEvent& event)
 	}
       else	// TODO: check value!
 	imageop->SetC(atof(c));
+      imageop->SetAdaptive(adaptive->GetValue());
     }
   if (op_choice->GetStringSelection() == "MMD")
     {
@@ -613,11 +590,26 @@ void MyFrame::OnDoit(wxCommandEvent& event)
 	imageop->SetAlpha(atof(alpha));
     }
 
-  timer_valid = FALSE; // timer's value is invalid. Used by GetTimer()
   Refresh();
-  timer.Reset();       // reset timer
-  timer.Start();       // start timer
-  if (op_choice->GetStringSelection() == "Metropolis")
+  imageop->StartTimer();
+  if (estimated)
+    {
+      /* unsupervised: the labeling and the class parameters are
+       * estimated in turn
+       */
+      int method = MRFEngine::METROPOLIS;
+      if (op_choice->GetStringSelection() == "MMD")
+	method = MRFEngine::MMD;
+      else if (op_choice->GetStringSelection() == "ICM")
+	method = MRFEngine::ICM_RASTER;
+      else if (op_choice->GetStringSelection() == "Gibbs sampler")
+	method = MRFEngine::GIBBS;
+      else if (op_choice->GetStringSelection() == "Graph cut")
+	method = MRFEngine::GRAPHCUT;
+      imageop->OptimizeUnsupervised(method);
+      ShowGaussians();
+    }
+  else if (op_choice->GetStringSelection() == "Metropolis")
     {
       imageop->Metropolis();
     }
@@ -633,8 +625,11 @@ void MyFrame::OnDoit(wxCommandEvent& event)
     {
       imageop->Gibbs();
     }
-  timer.Stop();       // stop timer
-  timer_valid = TRUE; // timer's value is valid. Used by GetTimer()
+  else if (op_choice->GetStringSelection() == "Graph cut")
+    {
+      imageop->GraphCut();
+    }
+  imageop->StopTimer();
   Refresh();
 }
 
@@ -643,15 +638,18 @@ void MyFrame::OnDoit(wxCommandEvent& event)
  */
 void MyFrame::OnChoice(wxCommandEvent& event)
 {
-	if (op_choice->GetStringSelection() == "ICM")
+	if (op_choice->GetStringSelection() == "ICM" ||
+	    op_choice->GetStringSelection() == "Graph cut")
 	{
 		tT0->Hide();
 		tc->Hide();
+		adaptive->Hide();
 	}
 	else
 	{
 		tT0->Show();
 		tc->Show();
+		adaptive->Show();
 	}
 	if (op_choice->GetStringSelection() == "MMD")
 	{
@@ -676,13 +674,15 @@ void MyFrame::OnRegions(wxCommandEvent& event)
     act_region = -1;
     imageop->SetNoRegions(-1);
     gaussians->SetValue("#\tMean\t\tVariance\n"); // clear parameter textfield
-
+    estimated = false;
   }
   doit_button->Disable();
   wxString str = regions->GetValue(); // get entered value
   // TODO: check wheter the value is a positive integer!
   if (str.Length() != 0) select_region_button->Enable();
   else select_region_button->Disable();
+  if (str.Length() != 0 && imageop->HasImage()) estimate_button->Enable();
+  else estimate_button->Disable();
 
 }
 
@@ -694,9 +694,14 @@ void MyFrame::OnSelectRegion(wxCommandEvent& event)
   static int no_regions=0;
   if (select_region_button->GetLabel() == "Select classes")
     {
-      act_region = 0;
       no_regions = atoi(regions->GetValue());     // get number of regions
-      imageop->SetNoRegions(no_regions);
+      if (!imageop->SetNoRegions(no_regions))
+	{
+	  wxMessageBox("Too many classes", "Error");
+	  return;
+	}
+      act_region = 0;
+      estimated = false;
       regs = new int[no_regions*4];                   // aloccate memory
       for (int i=0; i<no_regions*4; ++i) regs[i] = 0; // init with 0
       select_region_button->SetLabel(act_region == no_regions-2? 
@@ -720,6 +725,47 @@ void MyFrame::OnSelectRegion(wxCommandEvent& event)
 }
 
 
+/* on "Estimate" button pushed: the class parameters are estimated
+ * from the histogram of the image instead of training rectangles, and
+ * re-estimated from the segmentation by "Do it"
+ */
+void MyFrame::OnEstimate(wxCommandEvent& event)
+{
+  int no_regions = atoi(regions->GetValue());
+  if (no_regions < 2)
+    {
+      wxMessageBox("At least 2 classes are needed", "Error");
+      return;
+    }
+  if (!imageop->SetNoRegions(no_regions))
+    {
+      wxMessageBox("Too many classes", "Error");
+      return;
+    }
+  delete [] regs;	// remove all rectangle selections
+  regs = NULL;
+  act_region = -1;
+  select_region_button->SetLabel("Select classes");
+  select_region_button->Enable();
+  imageop->EstimateClasses();
+  estimated = true;
+  ShowGaussians();
+  doit_button->Enable();
+  input_window->Refresh();
+}
+
+
+/* prints the parameters of all classes in the gaussians textfield
+ */
+void MyFrame::ShowGaussians()
+{
+  gaussians->SetValue("#\tMean\t\tVariance\n");
+  for (int i=0; i<imageop->GetNoRegions(); ++i)
+    *gaussians << i+1 << "\t" << imageop->GetMean(i) << "\t\t"
+	       << imageop->GetVariance(i) << "\n";
+}
+
+
 /* return the coordinates of the given training rectangle 
  */
 void MyFrame::GetRegion(int &x, int &y, int &w, int &h, int region)
@@ -744,20 +790,26 @@ void MyFrame::GetRegion(int &x, int &y, int &w, int &h, int region)
 /*********************************************************************
 /* Functions of ImageOperations class
 /********************************************************************/
-ImageOperations::ImageOperations(wxWindow *_frame)
+ImageOperations::ImageOperations(wxWindow *_frame): timer("core")
 {
   frame = _frame;
   in_image = out_image = NULL;
+  timer_valid = FALSE;
+}
 
-  no_regions = -1; // -1 ==> num. of regions has not been specified yet!
-  beta = -1;
-  T0 = -1;
-  c = -1;
-  K = 0;
-  E = 0;
-  T = 0;
-  mean = variance = NULL;
-  alpha = 0.1;
+
+void ImageOperations::StartTimer()
+{
+  timer_valid = FALSE; // timer's value is invalid. Used by GetTimer()
+  timer.Reset();       // reset timer
+  timer.Start();       // start timer
+}
+
+
+void ImageOperations::StopTimer()
+{
+  timer.Stop();       // stop timer
+  timer_valid = TRUE; // timer's value is valid. Used by GetTimer()
 }
 
 
@@ -767,8 +819,8 @@ wxImage *ImageOperations::LoadBmp(wxString bmp_name)
   if (img->Ok()) // set new values						
     {
       in_image = img;
-      height = in_image->GetHeight();
-      width = in_image->GetWidth();
+      SetImage(in_image->GetData(), in_image->GetWidth(),
+	       in_image->GetHeight(), 3);
       out_image = NULL;
     }
   return in_image;
@@ -788,24 +840,6 @@ bool ImageOperations::IsOutput()
 }
 
 
-void ImageOperations::SetNoRegions(int n) 
-{ 
-  no_regions = n;
-  if (n == -1)
-    {
-      delete [] mean;
-      delete [] variance;
-      mean = variance = NULL;
-    }
-  else 
-    {
-      mean = new double[n]; 
-      variance = new double[n]; 
-      for (int i=0; i<n; ++i) mean[i] = variance[i] = -1;
-    }
-}
-
-	
 /* Compute mean and variance for a given region
  */
 void ImageOperations::CalculateMeanAndVariance(int region)
@@ -813,131 +847,15 @@ void ImageOperations::CalculateMeanAndVariance(int region)
   if (in_image != NULL)
     {
       int x, y, w, h;
-      int i, j;
       ((MyFrame *)frame)->GetRegion(x, y, w, h, region);
-
-      double sum = 0, sum2=0;
-      unsigned char *in_data = in_image->GetData();
-      for (i=y; i<y+h; ++i)
-	for (j=x; j<x+w; ++j) {
-	  sum += in_data[i*width*3+j*3];
-	  sum2 += in_data[i*width*3+j*3]*in_data[i*width*3+j*3];
-	}
-      mean[region] = sum/(w*h);
-      variance[region] = (sum2 - (sum*sum)/(w*h))/(w*h-1);
-//       sum = 0;
-//       for (i=y; i<y+h; ++i)
-// 	for (j=x; j<x+w; ++j)
-// 	  sum += pow(in_data[i*width*3+j*3] - mean[region], 2);
-//       variance[region] = sum/(w*h);
-      if (variance[region] == 0) variance[region] = 1e-10;
+      if (!MRFEngine::CalculateMeanAndVariance(region, x, y, w, h))
+	return;		// less than 2 pixels
       // print parameters in gaussians textfield
-      *gaussians << region+1 << "\t" << mean[region] << "\t\t" << variance[region] << "\n";
+      *((MyFrame *)frame)->GetGaussians() << region+1 << "\t" << mean[region] << "\t\t" << variance[region] << "\n";
     }
 }
 
 
-double ImageOperations::Singleton(int i, int j, int label)
-{
-  return log(sqrt(2.0*3.141592653589793*variance[label])) +
-    pow((double)in_image_data[i][j]-mean[label],2)/(2.0*variance[label]);
-}
-
-
-double ImageOperations::Doubleton(int i, int j, int label)
-{
-  double energy = 0.0;
-
-  if (i!=height-1) // south
-    {
-      if (label == classes[i+1][j]) energy -= beta;
-      else energy += beta;
-    }
-  if (j!=width-1) // east
-    {
-      if (label == classes[i][j+1]) energy -= beta;
-      else energy += beta;
-    }
-  if (i!=0) // nord
-    {
-      if (label == classes[i-1][j]) energy -= beta;
-      else energy += beta;
-    }
-  if (j!=0) // west
-    {
-      if (label == classes[i][j-1]) energy -= beta;
-      else energy += beta;
-    }
-  return energy;
-}
-
-
-/* compute global energy
- */
-double ImageOperations::CalculateEnergy()
-{
-  double singletons = 0.0;
-  double doubletons = 0.0;
-  int i, j, k;
-  for (i=0; i<height; ++i)
-    for (j=0; j<width; ++j)
-      {
-	k = classes[i][j];
-	// singleton
-	singletons += Singleton(i,j,k);
-	// doubleton
-	doubletons += Doubleton(i,j,k); // Note: here each doubleton is
-					// counted twice ==> divide by
-					// 2 at the end!
-      }
-  return singletons + doubletons/2; 
-}
-
-
-
-double ImageOperations::LocalEnergy(int i, int j, int label)
-{
-  return Singleton(i,j,label) + Doubleton(i,j,label);
-}
-
-
-/* Initialize segmentation
- */
-void ImageOperations::InitOutImage()
-{
-  int i, j, r;
-  double e, e2;	 // store local energy
-
-  unsigned char *in_data = in_image->GetData();
-
-  in_image_data = new int* [height]; // allocate memory for in_image_data
-  for (i=0; i<height; ++i)
-    in_image_data[i] = new int[width];
-
-  for (i=0; i<height; ++i)
-    for (j=0; j<width; ++j)
-      in_image_data[i][j] = in_data[(i*width*3)+j*3];
-
-	
-  classes = new int* [height]; // allocate memory for classes
-  for (i=0; i<height; ++i)
-    classes[i] = new int[width];
-  /* initialize using Maximum Likelihood (~ max. of singleton energy)
-   */
-  for (i=0; i<height; ++i)
-    for (j=0; j<width; ++j)
-      {
-	e = Singleton(i, j, 0);
-	classes[i][j] = 0;
-	for (r=1; r<no_regions; ++r)
-	  if ((e2=Singleton(i, j, r)) < e)
-	    {
-	      e = e2;
-	      classes[i][j] = r;
-	    }
-      }
-}
-
 /* Create and display the output image based on the current labeling.
  * Executed at each iteration.
  */
@@ -957,11 +875,11 @@ void ImageOperations::CreateOutput()
     for (j=0; j<width; ++j)
       {
 	out_data[(i*width*3) + j*3] = 
-	  (unsigned char)(classes[i][j]*255/no_regions);
+	  (unsigned char)(GetLabel(i,j)*255/no_regions);
 	out_data[(i*width*3) + j*3 +1] = 
-	  (unsigned char)(classes[i][j]*255/no_regions);
+	  (unsigned char)(GetLabel(i,j)*255/no_regions);
 	out_data[(i*width*3) + j*3 +2] = 
-	  (unsigned char)(classes[i][j]*255/no_regions);
+	  (unsigned char)(GetLabel(i,j)*255/no_regions);
       }
 
   free (out_image);
@@ -978,148 +896,3 @@ void ImageOperations::CreateOutput()
    */
   timer.Start();
 }
-
-
-/* Metropolis & MMD
- */
-void ImageOperations::Metropolis(bool mmd)
-{
-  InitOutImage();
-  int i, j;
-  int r;
-  double kszi = log(alpha);  // This is for MMD. When executing
-			    // Metropolis, kszi will be randomly generated.
-  double summa_deltaE;
-  
-  TRandomMersenne rg(time(0));  // create instance of random number generator
-
-  K = 0;
-  T = T0;
-  E_old = CalculateEnergy();
-
-  do
-    {
-      summa_deltaE = 0.0;
-      for (i=0; i<height; ++i)
-	for (j=0; j<width; ++j)
-	  {
-	    /* Generate a new label different from the current one with
-	     * uniform distribution.
-	     */
-	    if (no_regions == 2)
-	      r = 1 - classes[i][j];
-	    else
-	      r = (classes[i][j] +
-		   (int)(rg.Random()*(no_regions-1))+1) % no_regions;
-	    if (!mmd)  // Metropolis: kszi is a  uniform random number
-	      kszi = log(rg.Random()); 
-	    /* Accept the new label according to Metropolis dynamics.
-	     */
-	    if (kszi <= (LocalEnergy(i, j, classes[i][j]) -
-			 LocalEnergy(i, j, r)) / T) {
-	      summa_deltaE += 
-		fabs(LocalEnergy(i, j, r) - LocalEnergy(i, j, classes[i][j]));
-	      E_old = E = E_old - 
-		LocalEnergy(i, j, classes[i][j]) + LocalEnergy(i, j, r);
-	      classes[i][j] = r;
-	    }
-	  }
-      T *= c;         // decrease temperature
-      ++K;	      // advance iteration counter
-      CreateOutput(); // display current labeling
-    } while (summa_deltaE > t); // stop when energy change is small
-}
-
-
-/* ICM
- */
-void ImageOperations::ICM()
-{
-  InitOutImage();
-  int i, j;
-  int r;
-  double summa_deltaE;
-
-  K = 0;
-  E_old = CalculateEnergy();
-
-  do
-    {
-      summa_deltaE = 0.0;
-      for (i=0; i<height; ++i)
-	for (j=0; j<width; ++j)
-	  {
-	    for (r=0; r<no_regions; ++r)
-	      {
-		if (LocalEnergy(i, j, classes[i][j]) > LocalEnergy(i, j, r))
-		  {
-		    classes[i][j] = r;
-		  }
-	      }
-	  }
-      E = CalculateEnergy();
-      summa_deltaE += fabs(E_old-E);
-      E_old = E;
-
-      ++K;	      // advance iteration counter
-      CreateOutput(); // display current labeling
-    }while (summa_deltaE > t); // stop when energy change is small
-}
-
-
-/* Gibbs sampler
- */
-void ImageOperations::Gibbs()
-{
-  InitOutImage();
-  int i, j;
-  double *Ek;		       // array to store local energies
-  int s;
-  double summa_deltaE;
-  double sumE;
-  double z;
-  double r;
-
-  TRandomMersenne rg(time(0)); // make instance of random number generator
-
-  Ek = new double[no_regions];
-
-  K = 0;
-  T = T0;
-  E_old = CalculateEnergy();
-
-  do
-    {
-      summa_deltaE = 0.0;
-      for (i=0; i<height; ++i)
-	for (j=0; j<width; ++j)
-	  {
-	    sumE = 0.0;
-	    for (s=0; s<no_regions; ++s)
-	      {
-		Ek[s] = exp(-LocalEnergy(i, j, s)/T);
-		sumE += Ek[s];
-	      }
-	    r = rg.Random();	// r is a uniform random number
-	    z = 0.0;
-	    for (s=0; s<no_regions; ++s)
-	      {
-		z += Ek[s]/sumE; 
-		if (z > r) // choose new label with probabilty exp(-U/T).
-		  {
-		    classes[i][j] = s;
-		    break;
-		  }
-	      }
-	  }
-      E = CalculateEnergy();
-      summa_deltaE += fabs(E_old-E);
-      E_old = E;
-
-      T *= c;         // decrease temperature
-      ++K;	      // advance iteration counter
-      CreateOutput(); // display current labeling
-    } while (summa_deltaE > t); // stop when energy change is small
-
-  delete Ek;
-}
@@ -0,0 +1,351 @@
+/******************************************************************
+ * Modul name : mrfbench.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Benchmark of the optimizers on the bundled test images. Every noisy
+ * image is segmented with fixed seed and class parameters by each
+ * method, at the original size and as synthetic upscaled variants
+ * (the noise-free image enlarged and corrupted with new noise of the
+ * same class statistics). The results are printed as JSON: sweeps to
+ * convergence, final energy, misclassification rate against the
+ * noise-free image, time and pixels/sec of each run, and the peak
+ * resident set size of the whole benchmark (the high-water mark of
+ * the process, which is that of its largest run).
+ *
+ * The class parameters are the ML estimates given the noise-free
+ * image: one class per gray level (color) of the original, with the
+ * mean and variance of the noisy pixels at these places. Color
+ * images are converted to luminance, since the engine segments gray
+ * level images.
+ *
+ *****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "mrfengine.h"
+#include "pnmio.h"
+#include "randomc.h"
+
+/* Timer classes
+ */
+#include "CKProcessTimeCounter.h"
+
+
+/* Test images, relative to the image directories. The first one of
+ * each set is the noise-free original.
+ */
+static const char *gray_images[] = { "trin.pgm", "trin-3.pgm", "trin0.pgm",
+				     "trin3.pgm", "trin5.pgm", "trin13.pgm",
+				     NULL };
+static const char *color_images[] = { "color.ppm", "color_105.ppm",
+				      "color_18.ppm", "color_26.ppm",
+				      "color_33.ppm", "color_59.ppm", NULL };
+
+static const char *method_names[] = { "metropolis", "mmd", "icm", "icm-cb",
+				      "icm-wl", "gibbs", "graphcut", "sw",
+				      "bp", "trws", NULL };
+static const int method_codes[] = { MRFEngine::METROPOLIS, MRFEngine::MMD,
+				    MRFEngine::ICM_RASTER,
+				    MRFEngine::ICM_CHECKERBOARD,
+				    MRFEngine::ICM_WORKLIST,
+				    MRFEngine::GIBBS, MRFEngine::GRAPHCUT,
+				    MRFEngine::SWENDSEN_WANG, MRFEngine::BP,
+				    MRFEngine::TRWS };
+
+
+/* Gray level image (luminance for color images)
+ */
+struct Image
+{
+  int width, height;
+  unsigned char *data;
+
+  Image() { width = height = 0; data = NULL; }
+  ~Image() { delete [] data; }
+  bool Read(const char *dir, const char *name);
+};
+
+
+bool Image::Read(const char *dir, const char *name)
+{
+  char path[1024];
+  int channels, i;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  unsigned char *rgb = ReadPNM(path, width, height, channels);
+  if (rgb == NULL)
+    {
+      fprintf(stderr, "mrfbench: can't read image %s\n", path);
+      return false;
+    }
+  delete [] data;
+  if (channels == 1)
+    data = rgb;
+  else
+    {
+      data = new unsigned char[width*height];
+      for (i=0; i<width*height; ++i)
+	data[i] = (unsigned char)(0.299*rgb[3*i] + 0.587*rgb[3*i+1] +
+				  0.114*rgb[3*i+2] + 0.5);
+      delete [] rgb;
+    }
+  return true;
+}
+
+
+static double WallTimeMs()
+{
+#ifdef _WIN32
+  return (double)GetTickCount();
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+#endif
+}
+
+
+/* Peak resident set size of the process in kB (-1 if unknown)
+ */
+static long PeakRSS()
+{
+#ifdef _WIN32
+  return -1;
+#else
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1024;	// bytes on Mac OS X
+#else
+  return ru.ru_maxrss;
+#endif
+#endif
+}
+
+
+/* Ground truth of a noise-free image: the label of each pixel and the
+ * ML class parameters of a noisy image. Returns the number of classes.
+ */
+static int Classes(const Image &clean, const Image &noisy, int *truth,
+		   double *mean, double *variance)
+{
+  int value_class[256];
+  int count[256];
+  int i, k, n = 0;
+
+  for (i=0; i<256; ++i) value_class[i] = -1;
+  for (i=0; i<clean.width*clean.height; ++i)
+    {
+      int v = clean.data[i];
+      if (value_class[v] < 0)
+	{
+	  value_class[v] = n;
+	  mean[n] = variance[n] = 0.0;
+	  count[n++] = 0;
+	}
+      k = truth[i] = value_class[v];
+      mean[k] += noisy.data[i];
+      variance[k] += (double)noisy.data[i]*noisy.data[i];
+      ++count[k];
+    }
+  for (k=0; k<n; ++k)
+    {
+      mean[k] /= count[k];
+      variance[k] = variance[k]/count[k] - mean[k]*mean[k];
+      if (variance[k] < 1.0) variance[k] = 1.0;
+    }
+  return n;
+}
+
+
+/* Enlarges the ground truth by factor and draws each pixel from the
+ * Gaussian of its class (the noisy images are not simply the original
+ * plus noise: their contrast differs).
+ */
+static void Upscale(const Image &clean, const int *truth, const double *mean,
+		    const double *variance, int factor, unsigned long seed,
+		    Image &out, int *out_truth)
+{
+  TRandomMersenne rg(seed);
+  int i, j, p, q;
+
+  out.width = clean.width*factor;
+  out.height = clean.height*factor;
+  delete [] out.data;
+  out.data = new unsigned char[out.width*out.height];
+  for (i=0; i<out.height; ++i)
+    for (j=0; j<out.width; ++j)
+      {
+	p = (i/factor)*clean.width + j/factor;
+	q = i*out.width + j;
+	/* Box-Muller transform
+	 */
+	double u = 1.0 - rg.Random();
+	double g = sqrt(-2.0*log(u)) * cos(2.0*3.141592653589793*rg.Random());
+	double v = mean[truth[p]] + g*sqrt(variance[truth[p]]) + 0.5;
+	out.data[q] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+	out_truth[q] = truth[p];
+      }
+}
+
+
+static void Usage()
+{
+  fprintf(stderr,
+	  "usage: mrfbench [options] [gray_dir [color_dir]]\n"
+	  "  -m methods   comma separated list of metropolis, mmd, icm,\n"
+	  "               icm-cb, icm-wl, gibbs, sw, graphcut, bp and trws\n"
+	  "               (default: icm,metropolis,mmd,gibbs)\n"
+	  "  -u factors   comma separated upscaling factors (default: 1,4)\n"
+	  "  -s seed      random seed (default: 1)\n"
+	  "  -p threads   number of threads (default: 1)\n"
+	  "  -b beta      weight of doubleton potentials (default: 0.9)\n"
+	  "The image directories default to ../images and\n"
+	  "../../ColorMRFdemo/images (as seen from MRFdemo/linux).\n"
+	  "The results are written to the standard output as JSON.\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *methods = "icm,metropolis,mmd,gibbs";
+  const char *factors = "1,4";
+  const char *dirs[2] = { "../images", "../../ColorMRFdemo/images" };
+  const char **images[2] = { gray_images, color_images };
+  unsigned long seed = 1;
+  int threads = 1, no_dirs = 0;
+  double beta = 0.9, t = 0.05, T0 = 4.0, c = 0.98, alpha = 0.1;
+  CKProcessTimeCounter timer("bench"); // CPU timer
+  bool first = true;
+  int i, s, f, m;
+
+  for (i=1; i<argc; ++i)
+    {
+      if (argv[i][0] != '-')
+	{
+	  if (no_dirs == 2) Usage();
+	  dirs[no_dirs++] = argv[i];
+	  continue;
+	}
+      if (i+1 >= argc || argv[i][1] == '\0' || argv[i][2] != '\0') Usage();
+      const char *arg = argv[++i];
+      switch (argv[i-1][1])
+	{
+	case 'm': methods = arg; break;
+	case 'u': factors = arg; break;
+	case 's': seed = strtoul(arg, NULL, 10); break;
+	case 'p': threads = atoi(arg); break;
+	case 'b': beta = atof(arg); break;
+	default: Usage();
+	}
+    }
+
+  printf("{\n  \"parameters\": { \"beta\": %g, \"t\": %g, \"T0\": %g, "
+	 "\"c\": %g, \"alpha\": %g, \"seed\": %lu, \"threads\": %d },\n"
+	 "  \"runs\": [", beta, t, T0, c, alpha, seed, threads);
+
+  for (s=0; s<2; ++s)
+    {
+      Image clean;
+      if (!clean.Read(dirs[s], images[s][0])) return 1;
+      int *truth = new int[clean.width*clean.height];
+
+      for (int n=1; images[s][n]!=NULL; ++n)
+	{
+	  Image noisy;
+	  double mean[256], variance[256];
+	  if (!noisy.Read(dirs[s], images[s][n])) return 1;
+	  if (noisy.width != clean.width || noisy.height != clean.height)
+	    {
+	      fprintf(stderr, "mrfbench: size of %s differs from %s\n",
+		      images[s][n], images[s][0]);
+	      return 1;
+	    }
+	  int no_regions = Classes(clean, noisy, truth, mean, variance);
+
+	  for (const char *fp=factors; *fp; )
+	    {
+	      f = atoi(fp);
+	      fp += strcspn(fp, ",");
+	      if (*fp) ++fp;
+	      if (f < 1) Usage();
+
+	      Image scaled;
+	      int *scaled_truth = truth;
+	      if (f > 1)
+		{
+		  scaled_truth = new int[clean.width*f*clean.height*f];
+		  Upscale(clean, truth, mean, variance, f, seed, scaled,
+			  scaled_truth);
+		}
+	      const Image &image = (f > 1 ? scaled : noisy);
+
+	      for (const char *mp=methods; *mp; )
+		{
+		  size_t len = strcspn(mp, ",");
+		  for (m=0; method_names[m]!=NULL; ++m)
+		    if (strlen(method_names[m]) == len &&
+			strncmp(mp, method_names[m], len) == 0) break;
+		  if (method_names[m] == NULL) Usage();
+		  mp += len;
+		  if (*mp) ++mp;
+
+		  MRFEngine engine;
+		  engine.SetImage(image.data, image.width, image.height);
+		  engine.SetNoRegions(no_regions);
+		  for (i=0; i<no_regions; ++i)
+		    engine.SetClass(i, mean[i], variance[i]);
+		  engine.SetBeta(beta);
+		  engine.SetT(t);
+		  engine.SetT0(T0);
+		  engine.SetC(c);
+		  engine.SetAlpha(alpha);
+		  engine.SetSeed(seed);
+		  engine.SetThreads(threads);
+
+		  timer.Reset();
+		  timer.Start();
+		  double wall = WallTimeMs();
+		  engine.Optimize(method_codes[m]);
+		  wall = WallTimeMs() - wall;
+		  timer.Stop();
+
+		  long errors = 0;
+		  for (i=0; i<image.height; ++i)
+		    for (int j=0; j<image.width; ++j)
+		      errors += (engine.GetLabel(i, j) !=
+				 scaled_truth[i*image.width+j]);
+		  double pixels = (double)image.width*image.height;
+		  int sweeps = engine.GetK();
+
+		  printf("%s\n    { \"image\": \"%s\", \"scale\": %d, "
+			 "\"width\": %d, \"height\": %d, \"classes\": %d, "
+			 "\"method\": \"%s\", \"sweeps\": %d, "
+			 "\"energy\": %.10g, \"error_rate\": %.6f, "
+			 "\"cpu_ms\": %.3f, \"wall_ms\": %.3f, "
+			 "\"pixels_per_sec\": %.6g }",
+			 first ? "" : ",", images[s][n], f, image.width,
+			 image.height, no_regions, method_names[m], sweeps,
+			 engine.GetE(), errors/pixels, timer.GetElapsedTimeMs(),
+			 wall, wall > 0 ? pixels*sweeps/(wall/1000.0) : 0.0);
+		  fflush(stdout);
+		  first = false;
+		}
+	      if (f > 1) delete [] scaled_truth;
+	    }
+	}
+      delete [] truth;
+    }
+  printf("\n  ],\n  \"peak_rss_kb\": %ld\n}\n", PeakRSS());
+  return 0;
+}
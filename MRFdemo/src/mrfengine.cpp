@@ -0,0 +1,2478 @@
+/******************************************************************
+ * Modul name : mrfengine.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * GUI-free implementation of the MRF segmentation model and of the
+ * Metropolis, MMD, ICM and Gibbs sampler optimizers. The algorithms
+ * were moved here from the ImageOperations class of mrf.cpp;
+ * displaying the result after each sweep is delegated to
+ * the OnIteration() hook.
+ *
+ *****************************************************************/
+
+#include "mrfengine.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Random number generators
+ */
+#include "randomc.h"   // define classes for random number generators
+#include "philox.h"    // counter-based random number generator
+
+#include "threadpool.h"
+#include "icmsimd.h"
+#include "maxflow.h"
+#include "beliefprop.h"
+#include "bitboard.h"
+#include "mixture.h"
+#include "schedule.h"
+#include "telemetry.h"
+#include "unionfind.h"
+
+
+/* Shared state of a checkerboard sweep. With a first order
+ * neighbourhood, sites of the same color ((i+j)%2) have no common
+ * clique, hence they are conditionally independent and can be
+ * updated at the same time. Each thread updates the sites of the
+ * current color in its own band of rows, using its own random number
+ * generator. Energy changes are accumulated per row and summed up in
+ * row order, so the sums do not depend on the number of threads.
+ */
+struct SweepJob
+{
+  MRFEngine *engine;
+  ThreadPool *pool;		// NULL: a single band, run by the caller
+  int color;			// color being updated
+  bool mmd;			// MMD instead of Metropolis
+  double kszi;			// log(alpha) for MMD
+  const ICMArgs *icm;		// image & model for the ICM kernel
+  ICMKernel kernel;		// ICM kernel
+  double *row_deltaE;		// sum of |deltaE| of the accepted moves
+  double *row_dE;		// and change of the energy in each row
+  label_t *reference;		// ICM labels of double precision (NULL if
+				// the agreement is not measured)
+  struct Band
+  {
+    TRandomMersenne *rg;	// random number stream of the thread
+    TRandomPhilox *philox;	// or counter-based generator (or NULL)
+    double *Ek;			// work space of the Gibbs sampler
+    int changed;		// number of changed labels
+    long counts[2];		// see MRFEngine::agreement
+    char pad[64];		// keep bands on separate cache lines
+  } *bands;
+  int no_bands;			// = number of threads
+
+  SweepJob(MRFEngine *e, ThreadPool *tp, int height, int no_regions,
+	   unsigned long seed, bool philox);
+  ~SweepJob();
+  void Run(ThreadPool::Job band);  // updates both colors
+  void Clear(int height);	   // clears the row accumulators
+  void Sum(int height, double &deltaE, double &dE); // adds them up
+  void Count(long *counts);	   // adds up and clears the band counts
+  long Changed();		   // adds up and clears the changed labels
+};
+
+
+SweepJob::SweepJob(MRFEngine *e, ThreadPool *tp, int height,
+		   int no_regions, unsigned long seed, bool philox)
+{
+  engine = e;
+  pool = tp;
+  color = 0;
+  mmd = false;
+  kszi = 0.0;
+  icm = NULL;
+  kernel = NULL;
+  row_deltaE = new double[height];
+  row_dE = new double[height];
+  reference = NULL;
+  no_bands = (tp != NULL ? tp->GetNoThreads() : 1);
+  bands = new Band[no_bands];
+  for (int k=0; k<no_bands; ++k)
+    {
+      bands[k].rg = NULL;
+      bands[k].philox = NULL;
+      if (philox)
+	bands[k].philox = new TRandomPhilox(seed);
+      else
+	{
+	  uint32 init[2];
+	  init[0] = seed;	// one stream for each (seed, thread) pair
+	  init[1] = k;
+	  bands[k].rg = new TRandomMersenne(seed);
+	  bands[k].rg->RandomInitByArray(init, 2);
+	}
+      bands[k].Ek = new double[no_regions];
+      bands[k].changed = 0;
+      bands[k].counts[0] = bands[k].counts[1] = 0;
+    }
+}
+
+
+SweepJob::~SweepJob()
+{
+  for (int k=0; k<no_bands; ++k)
+    {
+      delete bands[k].rg;
+      delete bands[k].philox;
+      delete [] bands[k].Ek;
+    }
+  delete [] bands;
+  delete [] row_deltaE;
+  delete [] row_dE;
+  delete [] reference;
+}
+
+
+void SweepJob::Run(ThreadPool::Job band)
+{
+  for (color=0; color<2; ++color)
+    if (pool != NULL)
+      pool->Run(band, this);
+    else
+      band(this, 0);
+}
+
+
+void SweepJob::Clear(int height)
+{
+  for (int i=0; i<height; ++i) row_deltaE[i] = row_dE[i] = 0.0;
+}
+
+
+void SweepJob::Sum(int height, double &deltaE, double &dE)
+{
+  for (int i=0; i<height; ++i)
+    {
+      deltaE += row_deltaE[i];
+      dE += row_dE[i];
+    }
+}
+
+
+void SweepJob::Count(long *counts)
+{
+  for (int k=0; k<no_bands; ++k)
+    {
+      counts[0] += bands[k].counts[0];
+      counts[1] += bands[k].counts[1];
+      bands[k].counts[0] = bands[k].counts[1] = 0;
+    }
+}
+
+
+long SweepJob::Changed()
+{
+  long n = 0;
+  for (int k=0; k<no_bands; ++k)
+    {
+      n += bands[k].changed;
+      bands[k].changed = 0;
+    }
+  return n;
+}
+
+
+/* Positions the generator at the numbers of site (i,j) in sweep K.
+ * The Mersenne twister is sequential, it is used as it is.
+ */
+static inline void SetPosition(TRandomMersenne &, int, int, int, int) {}
+static inline void SetPosition(TRandomPhilox &rg, int K, int i, int j,
+			       int width)
+{
+  rg.SetCounter((uint64_t)i*width + j, K);
+}
+
+
+/* Positions the generator at the numbers of the cluster rooted at site
+ * s in sweep K (a stream apart from those of SetPosition())
+ */
+static inline void SetClusterPosition(TRandomMersenne &, int, int) {}
+static inline void SetClusterPosition(TRandomPhilox &rg, int K, int s)
+{
+  rg.SetCounter(s, K | 0x80000000u);
+}
+
+
+/* Shared state of a Swendsen-Wang sweep (see RunSwendsenWang()). The
+ * sites (index i*width+j) are divided among the threads in bands of
+ * rows, as in SweepJob. A thread links the bonded sites of its own
+ * band only, so the threads never touch the same trees of the forest;
+ * the bonds into a later band are collected and linked afterwards by
+ * the caller.
+ */
+struct ClusterJob
+{
+  MRFEngine *engine;
+  ThreadPool *pool;		// NULL: a single band, run by the caller
+  enum Phase { BONDS, ROOTS, LABELS } phase; // see ClusterBand()
+  double p;			// probability of a bond between two
+				// neighbours having the same label
+  UnionFind forest;		// the clusters
+  int *root;			// root of each site (see ROOTS)
+  label_t *labels;		// new label of each cluster, indexed by
+				// its root
+  struct Band
+  {
+    TRandomMersenne *rg;	// random number stream of the thread
+    TRandomPhilox *philox;	// or counter-based generator (or NULL)
+    int *cross;			// pairs of sites bonded across the
+    int no_cross;		// lower edge of the band
+    int no_roots;		// clusters rooted in the band
+    int changed;		// labels changed in the band
+    char pad[64];		// keep bands on separate cache lines
+  } *bands;
+  int no_bands;			// = number of threads
+
+  ClusterJob(MRFEngine *e, ThreadPool *tp, int sites, int max_cross,
+	     unsigned long seed, bool philox);
+  ~ClusterJob();
+  void Run(ThreadPool::Job band, Phase phase);
+};
+
+
+ClusterJob::ClusterJob(MRFEngine *e, ThreadPool *tp, int sites,
+		       int max_cross, unsigned long seed, bool philox)
+{
+  engine = e;
+  pool = tp;
+  phase = BONDS;
+  p = 0.0;
+  forest.Resize(sites);
+  root = new int[sites];
+  labels = new label_t[sites];
+  no_bands = (tp != NULL ? tp->GetNoThreads() : 1);
+  bands = new Band[no_bands];
+  for (int k=0; k<no_bands; ++k)
+    {
+      bands[k].rg = NULL;
+      bands[k].philox = NULL;
+      if (philox)
+	bands[k].philox = new TRandomPhilox(seed);
+      else
+	{
+	  uint32 init[2];
+	  init[0] = seed;	// one stream for each (seed, thread) pair
+	  init[1] = k;
+	  bands[k].rg = new TRandomMersenne(seed);
+	  bands[k].rg->RandomInitByArray(init, 2);
+	}
+      bands[k].cross = new int[2*max_cross];
+      bands[k].no_cross = bands[k].no_roots = 0;
+    }
+}
+
+
+ClusterJob::~ClusterJob()
+{
+  for (int k=0; k<no_bands; ++k)
+    {
+      delete bands[k].rg;
+      delete bands[k].philox;
+      delete [] bands[k].cross;
+    }
+  delete [] bands;
+  delete [] root;
+  delete [] labels;
+}
+
+
+void ClusterJob::Run(ThreadPool::Job band, Phase _phase)
+{
+  phase = _phase;
+  if (pool != NULL)
+    pool->Run(band, this);
+  else
+    band(this, 0);
+}
+
+
+/* Shared state of replica exchange (see RunReplicaExchange()). Every
+ * chain is an engine of its own with its own labeling, energy and
+ * random number stream; the chains share only the singleton table of
+ * the model, which is read only. Thread k runs the chains k,
+ * k+no_threads, ... and touches nothing else, so the sweeps need no
+ * locking, and the exchanges are done by the caller between two runs
+ * of the pool.
+ */
+struct ReplicaJob
+{
+  MRFEngine *chains;
+  int n;			// number of chains
+  int no_threads;
+  bool gibbs;			// Gibbs sampler instead of Metropolis
+  int sweeps;			// sweeps of a chain between exchanges
+  struct Chain
+  {
+    TRandomMersenne *rg;	// random number stream of the chain
+    TRandomPhilox *philox;	// or counter-based generator (or NULL)
+    double *Ek;			// work space of the Gibbs sampler
+    ImageBuffer<label_t> best;	// lowest energy labeling of the chain
+    double best_E;		// and its energy
+  } *replicas;
+
+  ReplicaJob(int n, int no_regions, unsigned long seed, bool philox);
+  ~ReplicaJob();
+};
+
+
+ReplicaJob::ReplicaJob(int _n, int no_regions, unsigned long seed,
+		       bool philox)
+{
+  n = _n;
+  chains = new MRFEngine[n];
+  no_threads = 1;
+  gibbs = false;
+  sweeps = 1;
+  replicas = new Chain[n];
+  for (int r=0; r<n; ++r)
+    {
+      replicas[r].rg = NULL;
+      replicas[r].philox = NULL;
+      if (philox)		// a key for each chain
+	replicas[r].philox = new TRandomPhilox(seed + ((uint64_t)r << 32));
+      else
+	{
+	  uint32 init[2];
+	  init[0] = seed;	// one stream for each (seed, chain) pair
+	  init[1] = r;
+	  replicas[r].rg = new TRandomMersenne(seed);
+	  replicas[r].rg->RandomInitByArray(init, 2);
+	}
+      replicas[r].Ek = new double[no_regions];
+    }
+}
+
+
+ReplicaJob::~ReplicaJob()
+{
+  for (int r=0; r<n; ++r)
+    {
+      delete replicas[r].rg;
+      delete replicas[r].philox;
+      delete [] replicas[r].Ek;
+    }
+  delete [] replicas;
+  delete [] chains;
+}
+
+
+MRFEngine::MRFEngine()
+{
+  width = height = 0;
+  no_regions = -1; // -1 ==> num. of regions has not been specified yet!
+  beta = -1;
+  t = 0.05;
+  T0 = -1;
+  c = -1;
+  K = 0;
+  changes = 0;
+  E = E_old = 0;
+  T = 0;
+  mean = variance = singletons = NULL;
+  shared_singletons = false;
+  boltzmann_singletons = boltzmann_ratios = NULL;
+  use_ratios = false;
+  precision = FLOAT64;
+  singletons32 = NULL;
+  singletons16 = NULL;
+  scale16 = 1.0;
+  agreement[0] = agreement[1] = 0;
+  alpha = 0.1;
+  seed = 0;
+  fixed_seed = false;
+  threads = 1;
+  levels = 1;
+  level = 0;
+  pool = NULL;
+  checkerboard = false;
+  verify = false;
+  energy_error = 0.0;
+  simd = true;
+  bitboard = false;
+  generator = MERSENNE;
+  neighbourhood = 4;
+  replicas = 1;
+  T_min = 0.1;
+  adaptive = false;
+  telemetry = NULL;
+}
+
+
+MRFEngine::~MRFEngine()
+{
+  delete [] mean;
+  delete [] variance;
+  if (!shared_singletons) delete [] singletons;
+  delete [] boltzmann_singletons;
+  delete [] singletons32;
+  delete [] singletons16;
+  delete pool;
+}
+
+
+void MRFEngine::SetImage(const unsigned char *data, int w, int h,
+			 int channels)
+{
+  int i, j;
+
+  classes.Clear();       // the old labeling belongs to the old image
+  moments[0].Clear();
+  moments[1].Clear();
+
+  width = w;
+  height = h;
+  in_image_data.Resize(width, height);
+  for (i=0; i<height; ++i)
+    {
+      unsigned char *row = in_image_data.Row(i);
+      for (j=0; j<width; ++j)
+	row[j] = data[(i*width*channels)+j*channels];
+    }
+}
+
+
+bool MRFEngine::SetNoRegions(int n)
+{
+  if (n > MRF_MAX_REGIONS) return false; // labels wouldn't fit in label_t
+  delete [] mean;
+  delete [] variance;
+  if (!shared_singletons) delete [] singletons;
+  delete [] boltzmann_singletons;
+  mean = variance = singletons = boltzmann_singletons = NULL;
+  shared_singletons = false;
+  no_regions = n;
+  if (n != -1)
+    {
+      mean = new double[n];
+      variance = new double[n];
+      singletons = new double[256*n];
+      boltzmann_singletons = new double[256*n];
+      for (int i=0; i<n; ++i) mean[i] = variance[i] = -1;
+    }
+  return true;
+}
+
+
+void MRFEngine::SetClass(int label, double m, double v)
+{
+  UnshareSingletons();
+  mean[label] = m;
+  variance[label] = (v == 0 ? 1e-10 : v);
+}
+
+
+/* Engines segmenting a batch of images concurrently are set up from
+ * the same model. The singleton table only depends on the class
+ * parameters, hence it is computed once by the model and only read by
+ * the others.
+ */
+void MRFEngine::SetModel(MRFEngine &model)
+{
+  SetNoRegions(model.no_regions);
+  for (int i=0; i<no_regions; ++i)
+    {
+      mean[i] = model.mean[i];
+      variance[i] = model.variance[i];
+    }
+  beta = model.beta;
+  t = model.t;
+  T0 = model.T0;
+  c = model.c;
+  alpha = model.alpha;
+  seed = model.seed;
+  fixed_seed = model.fixed_seed;
+  threads = model.threads;
+  levels = model.levels;
+  checkerboard = model.checkerboard;
+  verify = model.verify;
+  simd = model.simd;
+  bitboard = model.bitboard;
+  precision = model.precision;
+  generator = model.generator;
+  neighbourhood = model.neighbourhood;
+  replicas = model.replicas;
+  T_min = model.T_min;
+  adaptive = model.adaptive;
+
+  if (no_regions > 0)
+    {
+      model.InitSingletons();
+      delete [] singletons;
+      singletons = model.singletons;
+      shared_singletons = true;
+    }
+}
+
+
+bool MRFEngine::SetNeighbourhood(int n)
+{
+  if (n != 4 && n != 8 && n != 24) return false;
+  neighbourhood = n;
+  return true;
+}
+
+
+/* Gives the engine its own singleton table before its class
+ * parameters change
+ */
+void MRFEngine::UnshareSingletons()
+{
+  if (shared_singletons)
+    {
+      singletons = new double[256*no_regions];
+      shared_singletons = false;
+    }
+}
+
+
+/* Summed-area tables: element (i,j) of moments[0] is the sum of the
+ * intensities of the sites above and to the left of (i,j), moments[1]
+ * the sum of their squares (row and column 0 are 0). The sums over any
+ * rectangle follow from its 4 corners. They are exact integers, hence
+ * the statistics are the same as those of a scan of the rectangle.
+ */
+void MRFEngine::InitMoments()
+{
+  int i, j;
+
+  moments[0].Resize(width+1, height+1);
+  moments[1].Resize(width+1, height+1);
+  for (j=0; j<=width; ++j) moments[0](0,j) = moments[1](0,j) = 0;
+  for (i=0; i<height; ++i)
+    {
+      const unsigned char *g = in_image_data.Row(i);
+      const uint64_t *s0 = moments[0].Row(i), *s1 = moments[1].Row(i);
+      uint64_t *d0 = moments[0].Row(i+1), *d1 = moments[1].Row(i+1);
+      uint64_t r0 = 0, r1 = 0;	// sums of the row so far
+      d0[0] = d1[0] = 0;
+      for (j=0; j<width; ++j)
+	{
+	  r0 += g[j];
+	  r1 += (uint64_t)g[j]*g[j];
+	  d0[j+1] = s0[j+1] + r0;
+	  d1[j+1] = s1[j+1] + r1;
+	}
+    }
+}
+
+
+/* Compute mean and variance for a given region in constant time from
+ * the summed-area tables (built at the first call for an image)
+ */
+bool MRFEngine::CalculateMeanAndVariance(int region, int x, int y,
+					 int w, int h)
+{
+  if (!HasImage() || x < 0 || y < 0 || w < 1 || h < 1 || w*h < 2 ||
+      x > width - w || y > height - h) return false;
+  UnshareSingletons();
+  if (moments[0].IsEmpty()) InitMoments();
+  double sum = (double)(moments[0](y+h,x+w) - moments[0](y,x+w) -
+			moments[0](y+h,x) + moments[0](y,x));
+  double sum2 = (double)(moments[1](y+h,x+w) - moments[1](y,x+w) -
+			 moments[1](y+h,x) + moments[1](y,x));
+  mean[region] = sum/(w*h);
+  variance[region] = (sum2 - (sum*sum)/(w*h))/(w*h-1);
+  if (variance[region] == 0) variance[region] = 1e-10;
+  return true;
+}
+
+
+/* Unsupervised estimation of the class parameters: the intensities
+ * are modeled as a mixture of no_regions Gaussians, fitted to the
+ * histogram of the image (see GaussianMixture). The classes are ordered
+ * by their means.
+ */
+bool MRFEngine::EstimateClasses()
+{
+  double histogram[256];
+  int i, j, k;
+
+  if (!HasImage() || no_regions < 1) return false;
+  for (k=0; k<256; ++k) histogram[k] = 0.0;
+  for (i=0; i<height; ++i)
+    {
+      const unsigned char *row = in_image_data.Row(i);
+      for (j=0; j<width; ++j) histogram[row[j]] += 1.0;
+    }
+
+  GaussianMixture mixture(no_regions);
+  mixture.KMeans(histogram);
+  mixture.EM(histogram);
+  mixture.Sort();
+  for (k=0; k<no_regions; ++k)
+    SetClass(k, mixture.GetMean(k), mixture.GetVariance(k));
+  return true;
+}
+
+
+/* The parameters of each class are recomputed from the intensity
+ * histogram of its sites in the current labeling. A class with less
+ * than 2 sites keeps its parameters. Returns the largest change of a
+ * mean or a standard deviation (-1 if there is no labeling).
+ */
+double MRFEngine::UpdateClasses()
+{
+  int i, j, k, g;
+  double change = 0.0;
+
+  if (!HasLabels()) return -1.0;
+  double *counts = new double[256*no_regions];
+  for (k=0; k<256*no_regions; ++k) counts[k] = 0.0;
+  for (i=0; i<height; ++i)
+    {
+      const unsigned char *row = in_image_data.Row(i);
+      const label_t *l = classes.Row(i);
+      for (j=0; j<width; ++j) counts[l[j]*256 + row[j]] += 1.0;
+    }
+
+  for (k=0; k<no_regions; ++k)
+    {
+      const double *h = counts + k*256;
+      double s0 = 0.0, s1 = 0.0, s2 = 0.0;
+      for (g=0; g<256; ++g)
+	{
+	  s0 += h[g];
+	  s1 += h[g]*g;
+	  s2 += h[g]*g*g;
+	}
+      if (s0 < 2.0) continue;
+      double m = s1/s0;
+      double v = (s2 - s1*m)/(s0-1.0);
+      if (v < MIXTURE_MIN_VARIANCE) v = MIXTURE_MIN_VARIANCE;
+      double d = fabs(m - mean[k]);
+      if (d > change) change = d;
+      d = fabs(sqrt(v) - sqrt(variance[k]));
+      if (d > change) change = d;
+      SetClass(k, m, v);
+    }
+  delete [] counts;
+  return change;
+}
+
+
+/* Segmentation without training rectangles: the parameters estimated
+ * from the histogram give a first labeling, which in turn gives better
+ * parameters, since the neighbours decide the sites where the classes
+ * overlap. Stops when no parameter changes by more than 0.01 gray
+ * level.
+ */
+int MRFEngine::OptimizeUnsupervised(int method, int rounds)
+{
+  int k;
+
+  if (!EstimateClasses()) return 0;
+  for (k=0; k<rounds; )
+    {
+      Optimize(method);
+      ++k;
+      if (UpdateClasses() < 0.01) break;
+    }
+  return k;
+}
+
+
+/* Precompute the singleton potential for each possible intensity
+ * and label. Intensities are 8 bit, hence the table has only
+ * 256*no_regions entries and the optimizers never have to call
+ * log() and pow() in their inner loops. Must be called whenever the
+ * class parameters change; the optimizers call it at start.
+ */
+void MRFEngine::InitSingletons()
+{
+  int g, label;
+
+  if (shared_singletons) return; // the model has done it
+  for (label=0; label<no_regions; ++label)
+    {
+      double norm = log(sqrt(2.0*3.141592653589793*variance[label]));
+      for (g=0; g<256; ++g)
+	singletons[g*no_regions+label] = norm +
+	  pow((double)g-mean[label],2)/(2.0*variance[label]);
+    }
+}
+
+
+/* Tables of the reduced precision decisions, see SetPrecision().
+ * The singletons of each intensity are shifted so that the smallest
+ * one is 0, which does not change any decision. In fixed point,
+ * 32000 units cover the largest singleton plus n|beta| (n neighbours),
+ * hence no sum of a singleton and a doubleton potential overflows 16
+ * bits; the scale depends on the variances (through the singletons)
+ * and on beta. If clip is true (ICM), singletons above 4n|beta|+1 are
+ * clipped there first: such labels lose against the one with the
+ * smallest singleton whatever the neighbours are, and the rest get a
+ * finer scale.
+ */
+void MRFEngine::InitReduced(bool clip)
+{
+  int g, r, n = 256*no_regions;
+  double b = fabs(beta), top = 0.0;
+
+  delete [] singletons32;
+  delete [] singletons16;
+  singletons32 = NULL;
+  singletons16 = NULL;
+  if (precision == FLOAT64) return;
+
+  double *shifted = new double[n];
+  for (g=0; g<256; ++g)
+    {
+      double *s = singletons + g*no_regions;
+      double m = s[0];
+      for (r=1; r<no_regions; ++r)
+	if (s[r] < m) m = s[r];
+      for (r=0; r<no_regions; ++r)
+	{
+	  shifted[g*no_regions+r] = s[r] - m;
+	  if (s[r] - m > top) top = s[r] - m;
+	}
+    }
+
+  if (precision == FLOAT32)
+    {
+      singletons32 = new float[n];
+      for (g=0; g<n; ++g) singletons32[g] = (float)shifted[g];
+      for (r=0; r<9; ++r) doubletons32[r] = (float)(beta*(r-4));
+    }
+  else
+    {
+      double nb = neighbourhood;
+      if (clip && top > 4.0*nb*b + 1.0) top = 4.0*nb*b + 1.0;
+      scale16 = (top + nb*b > 0.0 ? 32000.0 / (top + nb*b) : 1.0);
+      singletons16 = new short[n+1];  // the kernels read one beyond
+      for (g=0; g<n; ++g)
+	singletons16[g] = (short)floor((shifted[g] < top ? shifted[g] : top)
+				       * scale16 + 0.5);
+      singletons16[n] = 0;
+      short bq = (short)floor(beta*scale16 + 0.5);
+      for (r=0; r<9; ++r) doubletons16[r] = (short)(bq*(r-4));
+    }
+  delete [] shifted;
+}
+
+
+template <class S>
+inline double MRFEngine::Doubleton(int i, int j, int label)
+{
+  int n[S::size];
+
+  Neighbours<S>(&classes(i,j), classes.GetStride(), i, j, width, height, n);
+  return Potts<S>(n, label, beta);
+}
+
+
+/* Same as Doubleton(i,j,label1) and Doubleton(i,j,label2) but the
+ * neighbours are read only once. The energies are accumulated in the
+ * same order as in Doubleton(), hence the results are bit-identical.
+ */
+template <class S>
+inline int MRFEngine::Doubletons(int i, int j, int label1, int label2,
+				 double &energy1, double &energy2)
+{
+  int n[S::size];
+  int d = 0;
+
+  Neighbours<S>(&classes(i,j), classes.GetStride(), i, j, width, height, n);
+  energy1 = energy2 = 0.0;
+  UNROLL_STENCIL
+  for (int k=0; k<S::size; ++k)
+    if (n[k] >= 0)
+      {
+	if (label1 == n[k]) { energy1 -= beta; ++d; } else energy1 += beta;
+	if (label2 == n[k]) { energy2 -= beta; --d; } else energy2 += beta;
+      }
+  return d;
+}
+
+
+/* compute global energy
+ */
+double MRFEngine::CalculateEnergy()
+{
+  return CalculateEnergy(0, height, 0, width);
+}
+
+
+double MRFEngine::CalculateEnergy(int i0, int i1, int j0, int j1)
+{
+  switch (neighbourhood)
+    {
+    case 8: return CalculateEnergy<Neighbourhood8>(i0, i1, j0, j1);
+    case 24: return CalculateEnergy<Neighbourhood24>(i0, i1, j0, j1);
+    }
+  return CalculateEnergy<Neighbourhood4>(i0, i1, j0, j1);
+}
+
+
+/* Energy of the sites in rows [i0,i1) and columns [j0,j1) and of the
+ * cliques joining them to their forward (south and east) neighbours.
+ * Summing it up over the tiles of a partition of the image gives the
+ * global energy.
+ */
+template <class S>
+double MRFEngine::CalculateEnergy(int i0, int i1, int j0, int j1)
+{
+  double sum_singletons = 0.0;
+  double sum_doubletons = 0.0;
+  int i, j, k, l;
+  for (i=i0; i<i1; ++i)
+    for (j=j0; j<j1; ++j)
+      {
+	l = classes(i,j);
+	// singleton
+	sum_singletons += Singleton(i,j,l);
+	// doubletons: each clique is counted once, at its upper/left site
+	for (k=0; k<S::size/2; ++k)
+	  {
+	    int y = i + S::Di(k), x = j + S::Dj(k);
+	    if (y < height && x >= 0 && x < width)
+	      sum_doubletons += (l == classes(y,x) ? -beta : beta);
+	  }
+      }
+  return sum_singletons + sum_doubletons;
+}
+
+
+/* The optimizers maintain the global energy incrementally, adding the
+ * change of the local energy whenever a label changes. In verification
+ * mode (see SetVerify()) it is also recomputed from scratch after each
+ * sweep; the largest difference is kept in energy_error and the
+ * recomputed value is used from then on.
+ */
+double MRFEngine::VerifyEnergy(double e)
+{
+  if (verify)
+    {
+      double full = CalculateEnergy();
+      if (fabs(full - e) > energy_error) energy_error = fabs(full - e);
+      e = full;
+    }
+  return e;
+}
+
+
+/* Adds a sweep of the optimizer, at temperature T and ending with
+ * energy E, to the telemetry (if there is one). changes are the labels
+ * changed by the sweep.
+ */
+void MRFEngine::RecordSweep(int sweep, long accepted)
+{
+  if (telemetry != NULL)
+    telemetry->Record(level, sweep, T, E, accepted, changes);
+}
+
+
+double MRFEngine::LocalEnergy(int i, int j, int label)
+{
+  switch (neighbourhood)
+    {
+    case 8: return LocalEnergy<Neighbourhood8>(i, j, label);
+    case 24: return LocalEnergy<Neighbourhood24>(i, j, label);
+    }
+  return LocalEnergy<Neighbourhood4>(i, j, label);
+}
+
+
+template <class S>
+inline double MRFEngine::LocalEnergy(int i, int j, int label)
+{
+  return Singleton(i,j,label) + Doubleton<S>(i,j,label);
+}
+
+
+/* Precompute the Boltzmann factors exp(-U/T) of the current
+ * temperature, so that the samplers need no exp() or log() in their
+ * inner loops. Called whenever T changes.
+ *
+ * Gibbs sampler: the factor of a label is the product of
+ *   boltzmann_singletons[g*no_regions+label] (the singleton potential
+ *     is taken relative to the smallest one of intensity g, which
+ *     cancels out in the normalization), and
+ *   boltzmann_doubletons[k], where k is the number of neighbours
+ *     having another label (the doubleton potential is 2*beta*k
+ *     above that of a site agreeing with all its neighbours).
+ * Factors of very improbable labels underflow to 0, which is harmless
+ * unless all of them do. With beta < 0 the doubleton factors grow
+ * with k and overflow at low temperatures. GibbsStep() checks both.
+ *
+ * Metropolis: the acceptance probability of the move q -> r is
+ *   boltzmann_ratios[(g*no_regions+q)*no_regions+r] *
+ *   boltzmann_pairs[d+MRF_MAX_NEIGHBOURS]
+ * where d is the # of neighbours labeled q minus the # of those
+ * labeled r. The ratio table has 256*n^2 entries, it is built only if
+ * that is less than the number of pixels. The tables are used only
+ * while all their exponents are within +-MAX_EXPONENT: at a lower
+ * temperature a factor could overflow, and limiting it would make the
+ * product wrong (e.g. an uphill move accepted with probability 1), so
+ * exp() is called for uphill moves instead.
+ */
+#define MAX_EXPONENT 300.0
+
+
+void MRFEngine::InitBoltzmann(bool gibbs)
+{
+  int g, q, r, k;
+  const double *s;
+
+  if (gibbs)
+    {
+      for (g=0; g<256; ++g)
+	{
+	  s = singletons + g*no_regions;
+	  double min = s[0];
+	  for (q=1; q<no_regions; ++q)
+	    if (s[q] < min) min = s[q];
+	  for (q=0; q<no_regions; ++q)
+	    boltzmann_singletons[g*no_regions+q] = exp(-(s[q]-min)/T);
+	}
+      for (k=0; k<=neighbourhood; ++k)
+	boltzmann_doubletons[k] = exp(-2.0*beta*k/T);
+    }
+  else
+    {
+      double range = 2.0*neighbourhood*fabs(beta); // largest exponent * T
+      for (g=0; g<256; ++g)
+	{
+	  s = singletons + g*no_regions;
+	  double min = s[0], max = s[0];
+	  for (q=1; q<no_regions; ++q)
+	    {
+	      if (s[q] < min) min = s[q];
+	      if (s[q] > max) max = s[q];
+	    }
+	  if (max - min > range) range = max - min;
+	}
+      use_ratios = (boltzmann_ratios != NULL && range <= MAX_EXPONENT*T);
+      if (!use_ratios) return;
+      for (g=0; g<256; ++g)
+	{
+	  s = singletons + g*no_regions;
+	  double *b = boltzmann_ratios + g*no_regions*no_regions;
+	  for (q=0; q<no_regions; ++q)
+	    for (r=0; r<no_regions; ++r)
+	      b[q*no_regions+r] = exp(-(s[r]-s[q])/T);
+	}
+      for (k=-neighbourhood; k<=neighbourhood; ++k)
+	boltzmann_pairs[k+MRF_MAX_NEIGHBOURS] = exp(-2.0*beta*k/T);
+    }
+}
+
+
+/* Initialize segmentation
+ */
+void MRFEngine::InitOutImage()
+{
+  int i, j, r;
+  double e, e2;	 // store local energy
+
+  InitSingletons();
+  classes.Resize(width, height); // reuses the memory of the last run
+  /* initialize using Maximum Likelihood (~ max. of singleton energy)
+   */
+  for (i=0; i<height; ++i)
+    for (j=0; j<width; ++j)
+      {
+	e = Singleton(i, j, 0);
+	classes(i,j) = 0;
+	for (r=1; r<no_regions; ++r)
+	  if ((e2=Singleton(i, j, r)) < e)
+	    {
+	      e = e2;
+	      classes(i,j) = r;
+	    }
+      }
+}
+
+
+/* Seed of the random number generator: either the one given by
+ * SetSeed() (reproducible runs) or the current time.
+ */
+unsigned long MRFEngine::Seed()
+{
+  return fixed_seed ? seed : (unsigned long)time(0);
+}
+
+
+/* Returns the thread pool of the parallel sweeps, or NULL if the
+ * sweeps have to be done serially.
+ */
+ThreadPool *MRFEngine::GetPool()
+{
+  int n = (threads > 0 ? threads : ThreadPool::NoCores());
+  if (n > height) n = height;	// at least one row per thread
+  if (pool != NULL && pool->GetNoThreads() != n)
+    {
+      delete pool;
+      pool = NULL;
+    }
+  if (pool == NULL && n > 1)
+    pool = new ThreadPool(n);
+  return pool;
+}
+
+
+/* One Metropolis/MMD step at site (i,j)
+ */
+template <class S, class RNG>
+inline bool MRFEngine::MetropolisStep(int i, int j, RNG &rg,
+				      bool mmd, double kszi,
+				      double &Eq, double &Er, long *counts)
+{
+  int q = classes(i,j);	// current label
+  int r;			// proposed label
+
+  SetPosition(rg, K, i, j, width);
+  /* Generate a new label different from the current one with
+   * uniform distribution.
+   */
+  if (no_regions == 2)
+    r = 1 - q;
+  else
+    r = (q + (int)(rg.Random()*(no_regions-1))+1) % no_regions;
+  double u = (mmd ? 0.0 : rg.Random()); // Metropolis: u is a
+					// uniform random number
+  /* Both local energies are evaluated only once per proposal
+   */
+  int g = in_image_data(i,j);
+  int d = Doubletons<S>(i, j, q, r, Eq, Er);
+  Eq += singletons[g*no_regions+q];
+  Er += singletons[g*no_regions+r];
+  /* Accept the new label according to Metropolis (log(u) <= -dE/T,
+   * where downhill moves are always accepted) or MMD dynamics.
+   */
+  bool accept;
+  if (mmd && precision != FLOAT64)
+    {
+      /* Eq - Er = Sq - Sr - 2*beta*d in reduced precision
+       */
+      const int k = g*no_regions;
+      if (precision == FLOAT32)
+	accept = (singletons32[k+q] - singletons32[k+r] -
+		  2.0f*doubletons32[5]*d >= (float)(T*kszi));
+      else
+	accept = (singletons16[k+q] - singletons16[k+r] -
+		  2*doubletons16[5]*d >= T*kszi*scale16);
+      if (counts != NULL)
+	{
+	  ++counts[0];
+	  counts[1] += (accept == (kszi <= (Eq - Er) / T));
+	}
+    }
+  else if (mmd)
+    accept = (kszi <= (Eq - Er) / T);
+  else if (Er <= Eq)
+    accept = true;
+  else if (use_ratios)
+    accept = (u <= boltzmann_ratios[(g*no_regions+q)*no_regions+r] *
+	      boltzmann_pairs[d+MRF_MAX_NEIGHBOURS]);
+  else
+    accept = (u <= exp((Eq - Er) / T));
+  if (accept)
+    {
+      classes(i,j) = r;
+      return true;
+    }
+  return false;
+}
+
+
+/* One Gibbs sampler step at site (i,j)
+ */
+template <class S, class RNG>
+inline double MRFEngine::GibbsStep(int i, int j, RNG &rg, double *Ek)
+{
+  int s;
+  double sumE = 0.0;
+  double z;
+  double r;
+  int n[S::size];
+
+  SetPosition(rg, K, i, j, width);
+  /* Labels of the neighbours (-1 if outside of the image) and the
+   * Boltzmann factors exp(-U/T) of the labels from the tables
+   */
+  int nb = Neighbours<S>(&classes(i,j), classes.GetStride(), i, j,
+			 width, height, n);
+  int g = in_image_data(i,j);
+  const double *bs = boltzmann_singletons + g*no_regions;
+  for (s=0; s<no_regions; ++s)
+    {
+      Ek[s] = bs[s] * boltzmann_doubletons[nb - Agreements<S>(n, s)];
+      sumE += Ek[s];
+    }
+  if (!(sumE >= 1e-200 && sumE <= DBL_MAX))
+    {
+      /* All the factors are (nearly) underflown, or some overflown
+       * (beta < 0), at very low temperatures: compute them relative
+       * to the lowest energy.
+       */
+      double min = Ek[0] = LocalEnergy<S>(i, j, 0);
+      for (s=1; s<no_regions; ++s)
+	if ((Ek[s] = LocalEnergy<S>(i, j, s)) < min) min = Ek[s];
+      sumE = 0.0;
+      for (s=0; s<no_regions; ++s)
+	{
+	  Ek[s] = exp(-(Ek[s]-min)/T);
+	  sumE += Ek[s];
+	}
+    }
+  r = rg.Random() * sumE; // r is a uniform random number in [0,sumE)
+  z = 0.0;
+  for (s=0; s<no_regions; ++s)
+    {
+      z += Ek[s];
+      if (z > r) // choose new label with probabilty exp(-U/T).
+	{
+	  int q = classes(i,j);
+	  if (s == q) break;
+	  classes(i,j) = s;
+	  /* change of the energy: that of the singleton and
+	   * 2*beta for each neighbour agreeing with q but not s
+	   */
+	  int agree = Agreements<S>(n, q) - Agreements<S>(n, s);
+	  return singletons[g*no_regions+s] - singletons[g*no_regions+q] +
+	    2.0*beta*agree;
+	}
+    }
+  return 0.0;
+}
+
+
+/* Raster scan sweeps over the sites in rows [i0,i1) and columns
+ * [j0,j1) (the whole image, except in the tiled engine)
+ */
+template <class S, class RNG>
+void MRFEngine::MetropolisSweep(RNG &rg, bool mmd, double kszi,
+				double &summa_deltaE,
+				int i0, int i1, int j0, int j1)
+{
+  double Eq, Er;	    // local energies of the current & new label
+
+  for (int i=i0; i<i1; ++i)
+    for (int j=j0; j<j1; ++j)
+      if (MetropolisStep<S>(i, j, rg, mmd, kszi, Eq, Er,
+			    verify ? agreement : NULL))
+	{
+	  summa_deltaE += fabs(Eq - Er);
+	  E_old = E = E_old - Eq + Er;
+	  ++changes;
+	}
+}
+
+
+template <class S, class RNG>
+void MRFEngine::GibbsSweep(RNG &rg, double *Ek, double &dE,
+			   int i0, int i1, int j0, int j1)
+{
+  for (int i=i0; i<i1; ++i)
+    for (int j=j0; j<j1; ++j)
+      {
+	int q = classes(i,j);
+	dE += GibbsStep<S>(i, j, rg, Ek);
+	changes += (classes(i,j) != q);
+      }
+}
+
+
+/* One ICM step at site (i,j): the label of the lowest local energy
+ * (the neighbours are read once for all the labels)
+ */
+template <class S>
+inline bool MRFEngine::ICMStep(int i, int j, double &dE)
+{
+  double e, e0;		// local energies of the new & old label
+  int q = classes(i,j);
+  int n[S::size];
+
+  Neighbours<S>(&classes(i,j), classes.GetStride(), i, j, width, height, n);
+  e0 = e = Singleton(i, j, q) + Potts<S>(n, q, beta);
+  for (int r=0; r<no_regions; ++r)
+    {
+      double er = Singleton(i, j, r) + Potts<S>(n, r, beta);
+      if (e > er)
+	{
+	  classes(i,j) = r;
+	  e = er;
+	}
+    }
+  dE += e - e0;
+  return classes(i,j) != q;
+}
+
+
+template <class S>
+void MRFEngine::ICMSweep(double &dE, int i0, int i1, int j0, int j1)
+{
+  for (int i=i0; i<i1; ++i)
+    for (int j=j0; j<j1; ++j)
+      changes += ICMStep<S>(i, j, dE);
+}
+
+/* instances used by the tiled engine
+ */
+template void MRFEngine::MetropolisSweep<Neighbourhood4>(TRandomMersenne &,
+							bool, double, double &,
+							int, int, int, int);
+template void MRFEngine::GibbsSweep<Neighbourhood4>(TRandomMersenne &,
+						   double *, double &,
+						   int, int, int, int);
+template void MRFEngine::ICMSweep<Neighbourhood4>(double &,
+						 int, int, int, int);
+
+
+/* Checkerboard sweeps: sites of the current color in the rows of a
+ * band. They return the number of changed labels.
+ */
+template <class RNG>
+int MRFEngine::MetropolisRows(SweepJob *job, int i0, int i1, RNG &rg,
+			       long *counts)
+{
+  double Eq, Er;
+  int changed = 0;
+
+  for (int i=i0; i<i1; ++i)
+    for (int j=(i+job->color)%2; j<width; j+=2)
+      if (MetropolisStep<Neighbourhood4>(i, j, rg, job->mmd, job->kszi,
+					 Eq, Er, counts))
+	{
+	  job->row_deltaE[i] += fabs(Eq - Er);
+	  job->row_dE[i] += Er - Eq;
+	  ++changed;
+	}
+  return changed;
+}
+
+
+template <class RNG>
+int MRFEngine::GibbsRows(SweepJob *job, int i0, int i1, RNG &rg,
+			 double *Ek)
+{
+  int changed = 0;
+
+  for (int i=i0; i<i1; ++i)
+    for (int j=(i+job->color)%2; j<width; j+=2)
+      {
+	int q = classes(i,j);
+	job->row_dE[i] += GibbsStep<Neighbourhood4>(i, j, rg, Ek);
+	changed += (classes(i,j) != q);
+      }
+  return changed;
+}
+
+
+void MRFEngine::MetropolisBand(void *arg, int thread)
+{
+  SweepJob *job = (SweepJob *)arg;
+  MRFEngine *e = job->engine;
+  SweepJob::Band &band = job->bands[thread];
+  int i0 = thread * e->height / job->no_bands;
+  int i1 = (thread+1) * e->height / job->no_bands;
+
+  long *counts = (e->verify ? band.counts : NULL);
+
+  if (band.philox != NULL)
+    band.changed += e->MetropolisRows(job, i0, i1, *band.philox, counts);
+  else
+    band.changed += e->MetropolisRows(job, i0, i1, *band.rg, counts);
+}
+
+
+void MRFEngine::GibbsBand(void *arg, int thread)
+{
+  SweepJob *job = (SweepJob *)arg;
+  MRFEngine *e = job->engine;
+  SweepJob::Band &band = job->bands[thread];
+  int i0 = thread * e->height / job->no_bands;
+  int i1 = (thread+1) * e->height / job->no_bands;
+
+  if (band.philox != NULL)
+    band.changed += e->GibbsRows(job, i0, i1, *band.philox, band.Ek);
+  else
+    band.changed += e->GibbsRows(job, i0, i1, *band.rg, band.Ek);
+}
+
+
+void MRFEngine::ICMBand(void *arg, int thread)
+{
+  SweepJob *job = (SweepJob *)arg;
+  MRFEngine *e = job->engine;
+  int i0 = thread * e->height / job->no_bands;
+  int i1 = (thread+1) * e->height / job->no_bands;
+  const ICMArgs &a = *job->icm;
+  SweepJob::Band &band = job->bands[thread];
+
+  if (job->reference != NULL)
+    ICMReference(a, i0, i1, job->color, job->reference, e->width);
+  band.changed += job->kernel(a, i0, i1, job->color);
+  if (job->reference != NULL)
+    for (int i=i0; i<i1; ++i)
+      for (int j=(i+job->color)%2; j<e->width; j+=2)
+	{
+	  ++band.counts[0];
+	  band.counts[1] += (a.labels[(size_t)i*a.label_stride+j] ==
+			     job->reference[(size_t)i*e->width+j]);
+	}
+}
+
+
+/* Checkerboard sweeps are used if they were asked for, or if there
+ * are several threads (the raster scan is inherently serial). The two
+ * colors are independent in the 4-neighbourhood only.
+ */
+SweepJob *MRFEngine::NewSweepJob()
+{
+  if (neighbourhood != 4) return NULL;
+  ThreadPool *tp = GetPool();
+  if (tp == NULL && !checkerboard && threads == 1) return NULL;
+  return new SweepJob(this, tp, height, no_regions, Seed(),
+		      generator == PHILOX);
+}
+
+
+/* Metropolis & MMD
+ */
+template <class S>
+void MRFEngine::RunMetropolis(bool mmd)
+{
+  double kszi = log(alpha);  // This is for MMD. When executing
+			    // Metropolis, kszi will be randomly generated.
+  double summa_deltaE;
+
+  if (bitboard && no_regions == 2 && S::size == 4)
+    {
+      RunBitboard(mmd);
+      return;
+    }
+
+  unsigned long s = Seed();
+  TRandomMersenne rg(s);  // create instance of random number generator
+  TRandomPhilox prg(s);	  // or counter-based generator
+  SweepJob *job = NewSweepJob();
+  if (job != NULL)	  // checkerboard sweeps
+    {
+      job->mmd = mmd;
+      job->kszi = kszi;
+    }
+  if (!mmd && 256.0*no_regions*no_regions <= (double)width*height)
+    boltzmann_ratios = new double[256*no_regions*no_regions];
+  if (mmd) InitReduced(false);
+  AnnealingSchedule schedule(adaptive, c, t, (double)width*height);
+
+  K = 0;
+  T = T0;
+  E_old = CalculateEnergy();
+
+  do
+    {
+      summa_deltaE = 0.0;
+      changes = 0;
+      if (!mmd) InitBoltzmann(false); // tables of the temperature T
+      if (job != NULL)
+	{
+	  job->Clear(height);
+	  job->Run(MetropolisBand);
+	  job->Sum(height, summa_deltaE, E_old);
+	  job->Count(agreement);
+	  changes = job->Changed();
+	}
+      else if (generator == PHILOX)
+	MetropolisSweep<S>(prg, mmd, kszi, summa_deltaE, 0, height, 0, width);
+      else
+	MetropolisSweep<S>(rg, mmd, kszi, summa_deltaE, 0, height, 0, width);
+      E = E_old = VerifyEnergy(E_old);
+      RecordSweep(K+1, changes);
+      T = schedule.Next(T, E, GetAcceptance()); // decrease temperature
+      ++K;	      // advance iteration counter
+      OnIteration();  // display current labeling
+    } while (summa_deltaE > t && // stop when energy change is small
+	     !schedule.Frozen());
+
+  delete [] boltzmann_ratios;
+  boltzmann_ratios = NULL;
+  delete job;
+}
+
+
+/* Two-class Metropolis & MMD on bit-packed labels
+ *
+ * The labels are kept in a BitBoard as well. The move at a site (to
+ * the other label) depends only on its intensity g, its label q and
+ * d = (# of neighbours labeled q) - (# labeled 1-q), and the latter
+ * two are obtained for a whole word of sites at once. Hence the
+ * energy change Er-Eq and the acceptance probability are tabulated by
+ * (q, d, g) (the probabilities at each temperature), and a site costs
+ * a few bit operations, two table lookups and, for uphill Metropolis
+ * moves only, a random number. Sites of one color don't interact, so
+ * the sites of a word are updated from the same counts.
+ */
+void MRFEngine::RunBitboard(bool mmd)
+{
+  int q, d, g, k;
+  const int n = 18*256;		// number of (q, d, g) triples
+  double kszi = log(alpha);
+  double summa_deltaE;
+  double dE;			// energy change of a sweep
+  double *energy = new double[n]; // Er-Eq
+  double *accept = new double[n]; // acceptance probability at T
+  BitBoard board;
+
+  for (q=0; q<2; ++q)
+    for (d=-4; d<=4; ++d)
+      for (g=0; g<256; ++g)
+	energy[(q*9+d+4)*256+g] = singletons[g*2+1-q] - singletons[g*2+q]
+	  + 2.0*beta*d;
+
+  unsigned long s = Seed();
+  TRandomMersenne rg(s);
+  TRandomPhilox prg(s);
+  board.Pack(classes);
+  AnnealingSchedule schedule(adaptive, c, t, (double)width*height);
+
+  K = 0;
+  T = T0;
+  E_old = CalculateEnergy();
+
+  do
+    {
+      for (k=0; k<n; ++k)
+	if (mmd)
+	  accept[k] = (kszi <= -energy[k] / T ? 1.0 : 0.0);
+	else
+	  accept[k] = (energy[k] <= 0.0 ? 1.0 : exp(-energy[k] / T));
+      summa_deltaE = 0.0;
+      dE = 0.0;
+      changes = 0;
+      if (generator == PHILOX)
+	BitboardSweep(board, prg, energy, accept, summa_deltaE, dE);
+      else
+	BitboardSweep(board, rg, energy, accept, summa_deltaE, dE);
+      E = E_old = VerifyEnergy(E_old + dE);
+      RecordSweep(K+1, changes);
+      T = schedule.Next(T, E, GetAcceptance()); // decrease temperature
+      ++K;	      // advance iteration counter
+      OnIteration();  // display current labeling
+    } while (summa_deltaE > t && // stop when energy change is small
+	     !schedule.Frozen());
+
+  delete [] energy;
+  delete [] accept;
+}
+
+
+template <class RNG>
+void MRFEngine::BitboardSweep(BitBoard &board, RNG &rg,
+			      const double *energy, const double *accept,
+			      double &summa_deltaE, double &dE)
+{
+  int words = board.GetWords();
+  uint64_t n1[3], n0[3];	// neighbour counts
+
+  for (int color=0; color<2; ++color)
+    for (int i=0; i<height; ++i)
+      {
+	uint64_t *r = board.Row(i);
+	const unsigned char *image = &in_image_data(i,0);
+	label_t *labels = &classes(i,0);
+	for (int w=0; w<words; ++w)
+	  {
+	    uint64_t sites = board.Sites(i, w, color);
+	    uint64_t flips = 0;
+	    board.Counts(i, w, n1, n0);
+	    while (sites)
+	      {
+		int b = LowestBit(sites);
+		int j = w*64 + b;
+		sites &= sites - 1;
+		int k = board.index[(r[w] >> b & 1) |
+				    (n1[0] >> b & 1) << 1 |
+				    (n1[1] >> b & 1) << 2 |
+				    (n1[2] >> b & 1) << 3 |
+				    (n0[0] >> b & 1) << 4 |
+				    (n0[1] >> b & 1) << 5 |
+				    (n0[2] >> b & 1) << 6]*256 + image[j];
+		double p = accept[k];
+		if (p < 1.0)
+		  {
+		    if (p == 0.0) continue;
+		    SetPosition(rg, K, i, j, width);
+		    if (rg.Random() > p) continue;
+		  }
+		flips |= (uint64_t)1 << b;
+		labels[j] ^= 1;
+		++changes;
+		summa_deltaE += fabs(energy[k]);
+		dE += energy[k];
+	      }
+	    r[w] ^= flips;
+	  }
+      }
+}
+
+
+/* ICM
+ *
+ * In checkerboard mode the sites of one color are updated first and
+ * then the sites of the other color. Within a color the updates are
+ * independent, hence they are done by the vectorized kernels of
+ * icmsimd.cpp (and by several threads if SetThreads() was called).
+ * The labeling is the same whichever kernel is used; it differs from
+ * the raster scan order of the default mode, though. The kernels are
+ * written for the 4-neighbourhood, with other stencils ICM runs in
+ * raster scan order.
+ */
+template <class S>
+void MRFEngine::RunICM(bool checkerboard)
+{
+  int r;
+  double summa_deltaE;
+  double dE;			// energy change of a sweep
+
+  ICMArgs args;
+  double doubletons[9];		// beta*k, k=-4..4
+  SweepJob *job = NULL;
+  if (S::size != 4) checkerboard = false;
+  if (checkerboard)
+    {
+      for (r=0; r<9; ++r) doubletons[r] = beta*(r-4);
+      args.labels = &classes(0,0);
+      args.label_stride = classes.GetStride();
+      args.image = &in_image_data(0,0);
+      args.image_stride = in_image_data.GetStride();
+      args.width = width;
+      args.height = height;
+      args.no_regions = no_regions;
+      args.singletons = singletons;
+      args.doubletons = doubletons;
+      InitReduced(true);
+      args.singletons32 = singletons32;
+      args.doubletons32 = doubletons32;
+      args.singletons16 = singletons16;
+      args.doubletons16 = doubletons16;
+      job = new SweepJob(this, GetPool(), height, no_regions, 0, false);
+      args.row_dE = job->row_dE;
+      job->icm = &args;
+      job->kernel = SelectICMKernel(simd, precision); // FLOAT64 is
+							 // ICM_FLOAT64, ...
+      if (verify && precision != FLOAT64)
+	job->reference = new label_t[(size_t)width*height];
+    }
+
+  K = 0;
+  E_old = CalculateEnergy();
+
+  do
+    {
+      summa_deltaE = 0.0;
+      dE = 0.0;
+      changes = 0;
+      if (!checkerboard)
+	ICMSweep<S>(dE, 0, height, 0, width);
+      else
+	{
+	  job->Clear(height);
+	  job->Run(ICMBand);
+	  job->Sum(height, summa_deltaE, dE);
+	  job->Count(agreement);
+	  changes = job->Changed();
+	}
+      E = VerifyEnergy(E_old + dE);
+      summa_deltaE = fabs(E_old-E);
+      E_old = E;
+      RecordSweep(K+1, changes);
+
+      ++K;	      // advance iteration counter
+      OnIteration();  // display current labeling
+    }while (summa_deltaE > t); // stop when energy change is small
+
+  delete job;
+}
+
+
+/* Worklist ICM
+ *
+ * A site keeps its label until one of its neighbours changes, so after
+ * the first sweep only the neighbours of the sites changed in the
+ * previous pass are visited again. A site is put on the list of the
+ * next pass only if it is not waiting in the current one (then it
+ * sees the change anyway). The passes stop when the list is empty,
+ * i.e. at a local minimum; the cost of a pass is proportional to the
+ * number of changes. The first pass is a raster scan, the later ones
+ * visit the sites in the order they were listed.
+ */
+template <class S>
+void MRFEngine::RunICMWorklist()
+{
+  int n = width*height;
+  int *list = new int[n];	// sites of the current pass
+  int *next = new int[n];	// sites of the next pass
+  unsigned char *state = new unsigned char[n]; // WAITING and/or LISTED
+  int no_list, no_next, k, p, i, j;
+  double dE;			// energy change of a pass
+  enum { WAITING=1, LISTED=2 };
+
+  for (p=0; p<n; ++p)
+    {
+      list[p] = p;
+      state[p] = WAITING;
+    }
+  no_list = n;
+
+  K = 0;
+  E_old = CalculateEnergy();
+
+  while (no_list > 0)
+    {
+      dE = 0.0;
+      no_next = 0;
+      changes = 0;
+      for (k=0; k<no_list; ++k)
+	{
+	  p = list[k];
+	  state[p] &= ~WAITING;
+	  i = p / width;
+	  j = p - i*width;
+	  if (!ICMStep<S>(i, j, dE)) continue;
+	  ++changes;
+	  /* list the neighbours: the backward ones (north/west), then
+	   * the forward ones in reverse order
+	   */
+	  for (int m=0; m<S::size; ++m)
+	    {
+	      int l = (m < S::size/2 ? m + S::size/2 : S::size-1 - m);
+	      int y = i + S::Di(l), x = j + S::Dj(l);
+	      int nb = y*width + x;
+	      if (y >= 0 && y < height && x >= 0 && x < width &&
+		  state[nb] == 0)
+		{
+		  state[nb] = LISTED;
+		  next[no_next++] = nb;
+		}
+	    }
+	}
+      for (k=0; k<no_next; ++k)
+	state[next[k]] = WAITING;
+      int *tmp = list;
+      list = next;
+      next = tmp;
+      no_list = no_next;
+
+      E = VerifyEnergy(E_old + dE);
+      E_old = E;
+      RecordSweep(K+1, changes);
+      ++K;	      // advance iteration counter
+      OnIteration();  // display current labeling
+    }
+
+  delete [] list;
+  delete [] next;
+  delete [] state;
+}
+
+
+/* Gibbs sampler
+ */
+template <class S>
+void MRFEngine::RunGibbs()
+{
+  double *Ek;		       // array to store local energies
+  double summa_deltaE;
+  double dE;		       // energy change of a sweep
+
+  unsigned long s = Seed();
+  TRandomMersenne rg(s); // make instance of random number generator
+  TRandomPhilox prg(s);	 // or counter-based generator
+  SweepJob *job = NewSweepJob(); // checkerboard sweeps (or NULL)
+
+  Ek = new double[no_regions];
+  AnnealingSchedule schedule(adaptive, c, t, (double)width*height);
+
+  K = 0;
+  T = T0;
+  E_old = CalculateEnergy();
+
+  do
+    {
+      summa_deltaE = 0.0;
+      dE = 0.0;
+      changes = 0;
+      InitBoltzmann(true);	// tables of the temperature T
+      if (job != NULL)
+	{
+	  job->Clear(height);
+	  job->Run(GibbsBand);
+	  job->Sum(height, summa_deltaE, dE);
+	  changes = job->Changed();
+	}
+      else if (generator == PHILOX)
+	GibbsSweep<S>(prg, Ek, dE, 0, height, 0, width);
+      else
+	GibbsSweep<S>(rg, Ek, dE, 0, height, 0, width);
+      /* E is the running sum of the local changes, which may differ
+       * from CalculateEnergy() in the last bits: a sweep whose change
+       * is within rounding of t can stop or continue the run where
+       * the recomputed energy would not, so the number of sweeps may
+       * differ from earlier versions for a given seed.
+       */
+      E = VerifyEnergy(E_old + dE);
+      summa_deltaE = fabs(E_old-E);
+      E_old = E;
+      RecordSweep(K+1, changes);
+
+      T = schedule.Next(T, E, GetAcceptance()); // decrease temperature
+      ++K;	      // advance iteration counter
+      OnIteration();  // display current labeling
+      /* The net energy change of a sweep may vanish by chance, the
+       * adaptive schedule stops only when the labeling freezes.
+       */
+    } while ((summa_deltaE > t || adaptive) && !schedule.Frozen());
+
+  delete [] Ek;
+  delete job;
+}
+
+
+/* Swendsen-Wang cluster sampler, see R. H. Swendsen, J.-S. Wang:
+ * Nonuniversal critical dynamics in Monte Carlo simulations. Physical
+ * Review Letters 58(2), 1987, and D. Higdon: Auxiliary variable
+ * methods for Markov chain Monte Carlo with applications. JASA 93,
+ * 1998, for the external field (the singletons).
+ *
+ * The doubleton potential of a clique is -beta if the labels agree,
+ * +beta otherwise. A sweep bonds each pair of neighbours having the
+ * same label with probability p = 1 - exp(-2 beta/T), and the
+ * connected components of the bonds (the clusters) take a new label
+ * each, drawn from the Gibbs distribution of the sum of the
+ * singletons of their sites. Whole regions thus change label in one
+ * step, which single site samplers reach only by crossing the high
+ * energy states in between. The bonds and the components are found
+ * by the threads in parallel (see ClusterJob); the sums over the
+ * clusters and the drawing of their labels are serial.
+ *
+ * Bonds are ferromagnetic only: with beta <= 0 the Gibbs sampler is
+ * run instead.
+ */
+template <class S, class RNG>
+void MRFEngine::BondRows(ClusterJob *job, int i0, int i1, RNG &rg,
+			 int thread)
+{
+  ClusterJob::Band &band = job->bands[thread];
+  UnionFind &forest = job->forest;
+  int i, j, k;
+
+  band.no_cross = 0;
+  for (i=i0; i<i1; ++i)
+    {
+      const label_t *l = classes.Row(i);
+      for (j=0; j<width; ++j)
+	{
+	  int s = i*width + j;
+	  SetPosition(rg, K, i, j, width);
+	  UNROLL_STENCIL
+	  for (k=0; k<S::size/2; ++k)	// forward neighbours
+	    {
+	      int y = i + S::Di(k), x = j + S::Dj(k);
+	      if (y >= height || x < 0 || x >= width ||
+		  classes(y,x) != l[j] || rg.Random() >= job->p)
+		continue;
+	      if (y < i1)
+		forest.Union(s, y*width + x);
+	      else
+		{
+		  band.cross[2*band.no_cross] = s;
+		  band.cross[2*band.no_cross+1] = y*width + x;
+		  ++band.no_cross;
+		}
+	    }
+	}
+    }
+}
+
+
+template <class S>
+void MRFEngine::ClusterBand(void *arg, int thread)
+{
+  ClusterJob *job = (ClusterJob *)arg;
+  MRFEngine *e = job->engine;
+  ClusterJob::Band &band = job->bands[thread];
+  int i0 = thread * e->height / job->no_bands;
+  int i1 = (thread+1) * e->height / job->no_bands;
+  int i, j, s;
+
+  switch (job->phase)
+    {
+    case ClusterJob::BONDS:
+      job->forest.Reset(i0*e->width, i1*e->width);
+      if (band.philox != NULL)
+	e->BondRows<S>(job, i0, i1, *band.philox, thread);
+      else
+	e->BondRows<S>(job, i0, i1, *band.rg, thread);
+      break;
+    case ClusterJob::ROOTS:
+      band.no_roots = 0;
+      for (s=i0*e->width; s<i1*e->width; ++s)
+	if ((job->root[s] = job->forest.Root(s)) == s) ++band.no_roots;
+      break;
+    case ClusterJob::LABELS:
+      band.changed = 0;
+      for (i=i0; i<i1; ++i)
+	{
+	  label_t *l = e->classes.Row(i);
+	  const int *r = job->root + i*e->width;
+	  for (j=0; j<e->width; ++j)
+	    {
+	      band.changed += (l[j] != job->labels[r[j]]);
+	      l[j] = job->labels[r[j]];
+	    }
+	}
+      break;
+    }
+}
+
+
+template <class S>
+void MRFEngine::RunSwendsenWang()
+{
+  double summa_deltaE;
+  int i, j, k, q, s;
+
+  if (beta <= 0.0)
+    {
+      RunGibbs<S>();
+      return;
+    }
+
+  unsigned long seed = Seed();
+  TRandomMersenne rg(seed); // the labels of the clusters
+  TRandomPhilox prg(seed);
+  ClusterJob job(this, GetPool(), width*height,
+		 S::reach*width*(S::size/2), seed, generator == PHILOX);
+  int *index = new int[width*height]; // # of the cluster of each root
+  double *sums = NULL;		      // singletons of the clusters
+  int capacity = 0;		      // clusters sums can hold
+  double *Ek = new double[no_regions];
+
+  K = 0;
+  T = T0;
+  E_old = CalculateEnergy();
+
+  do
+    {
+      long relabeled = 0;	// clusters having a new label
+
+      /* clusters
+       */
+      job.p = 1.0 - exp(-2.0*beta/T);
+      job.Run(ClusterBand<S>, ClusterJob::BONDS);
+      for (k=0; k<job.no_bands; ++k)
+	{
+	  const int *c = job.bands[k].cross;
+	  for (i=0; i<job.bands[k].no_cross; ++i)
+	    job.forest.Union(c[2*i], c[2*i+1]);
+	}
+      job.Run(ClusterBand<S>, ClusterJob::ROOTS);
+
+      /* sum of the singletons of each cluster for each label
+       */
+      int n = 0;
+      for (k=0; k<job.no_bands; ++k) n += job.bands[k].no_roots;
+      if (n > capacity)
+	{
+	  delete [] sums;
+	  capacity = n;
+	  sums = new double[(size_t)capacity*no_regions];
+	}
+      for (n=0, s=0, i=0; i<height; ++i)
+	{
+	  const unsigned char *g = in_image_data.Row(i);
+	  for (j=0; j<width; ++j, ++s)
+	    {
+	      double *sum;
+	      const double *e = singletons + g[j]*no_regions;
+	      if (job.root[s] == s)
+		{
+		  index[s] = n;
+		  sum = sums + (size_t)(n++)*no_regions;
+		  for (q=0; q<no_regions; ++q) sum[q] = e[q];
+		}
+	      else
+		{
+		  sum = sums + (size_t)index[job.root[s]]*no_regions;
+		  for (q=0; q<no_regions; ++q) sum[q] += e[q];
+		}
+	    }
+	}
+
+      /* new label of each cluster
+       */
+      for (s=0; s<width*height; ++s)
+	if (job.root[s] == s)
+	  {
+	    const double *sum = sums + (size_t)index[s]*no_regions;
+	    double min = sum[0], total = 0.0;
+	    for (q=1; q<no_regions; ++q)
+	      if (sum[q] < min) min = sum[q];
+	    for (q=0; q<no_regions; ++q)
+	      total += (Ek[q] = exp(-(sum[q]-min)/T));
+	    double r;
+	    if (generator == PHILOX)
+	      {
+		SetClusterPosition(prg, K, s);
+		r = prg.Random()*total;
+	      }
+	    else
+	      r = rg.Random()*total;
+	    for (q=0; q<no_regions-1 && r >= Ek[q]; ++q) r -= Ek[q];
+	    job.labels[s] = (label_t)q;
+	    relabeled += (q != classes(s / width, s % width));
+	  }
+      job.Run(ClusterBand<S>, ClusterJob::LABELS);
+      changes = 0;
+      for (k=0; k<job.no_bands; ++k) changes += job.bands[k].changed;
+
+      E = CalculateEnergy();	// a sweep may change any site
+      summa_deltaE = fabs(E_old-E);
+      E_old = E;
+      RecordSweep(K+1, relabeled);
+
+      T *= c;         // decrease temperature
+      ++K;	      // advance iteration counter
+      OnIteration();  // display current labeling
+    } while (summa_deltaE > t); // stop when energy change is small
+
+  delete [] index;
+  delete [] sums;
+  delete [] Ek;
+}
+
+
+/* Replica exchange (parallel tempering), see K. Hukushima, K. Nemoto:
+ * Exchange Monte Carlo method and application to spin glass
+ * simulations. J. Phys. Soc. Jpn. 65(6), 1996.
+ *
+ * Instead of a single chain annealed by T(n+1) = c*T(n), n chains run
+ * at the fixed temperatures of a geometric ladder from T_min (chain 0)
+ * to T0, one thread each. After every few sweeps the chains of
+ * neighbouring temperatures (pairs of even and odd rungs in turn)
+ * exchange their labelings with probability
+ * min(1, exp((1/Ti - 1/Tj)(Ei - Ej))), which keeps each chain at
+ * equilibrium at its own temperature. A labeling trapped in a local
+ * minimum at a low temperature is thus carried up the ladder, molten
+ * and brought down again, while good labelings found by the hot
+ * chains sink to the cold ones, so no schedule has to be tuned.
+ * Exchanging two labelings only swaps two buffers.
+ *
+ * The result is the lowest energy labeling any chain went through. It
+ * is stopped when n exchange periods in a row (the time a labeling
+ * needs to cross the ladder) have not improved it by more than t. K
+ * counts the sweeps of a chain.
+ */
+#define REPLICA_SWEEPS 4	// sweeps of each chain between exchanges
+
+
+template <class S, class RNG>
+void MRFEngine::ReplicaSweeps(ReplicaJob *job, int r, RNG &rg)
+{
+  ReplicaJob::Chain &chain = job->replicas[r];
+
+  for (int k=0; k<job->sweeps; ++k)
+    {
+      double summa_deltaE = 0.0, dE = 0.0;
+      if (job->gibbs)
+	{
+	  GibbsSweep<S>(rg, chain.Ek, dE, 0, height, 0, width);
+	  E = E_old = E_old + dE;
+	}
+      else
+	MetropolisSweep<S>(rg, false, 0.0, summa_deltaE,
+			   0, height, 0, width);
+      ++K;
+      if (E < chain.best_E)
+	{
+	  chain.best_E = E;
+	  chain.best.Copy(classes);
+	}
+    }
+}
+
+
+template <class S>
+void MRFEngine::ReplicaBand(void *arg, int thread)
+{
+  ReplicaJob *job = (ReplicaJob *)arg;
+
+  for (int r=thread; r<job->n; r+=job->no_threads)
+    {
+      MRFEngine &e = job->chains[r];
+      if (job->replicas[r].philox != NULL)
+	e.ReplicaSweeps<S>(job, r, *job->replicas[r].philox);
+      else
+	e.ReplicaSweeps<S>(job, r, *job->replicas[r].rg);
+    }
+}
+
+
+template <class S>
+void MRFEngine::RunReplicaExchange(bool gibbs)
+{
+  int n = (replicas > 0 ? replicas : ThreadPool::NoCores());
+  int r, round;
+  int idle = 0;			// periods without improvement
+  double best_E;
+
+  unsigned long seed = Seed();
+  TRandomMersenne rg(seed);	// the exchanges
+  ReplicaJob job(n, no_regions, seed, generator == PHILOX);
+  job.gibbs = gibbs;
+  job.sweeps = REPLICA_SWEEPS;
+  job.no_threads = (n < ThreadPool::NoCores() ? n : ThreadPool::NoCores());
+  ThreadPool *tp = (job.no_threads > 1 ? new ThreadPool(job.no_threads) :
+		    NULL);
+
+  for (r=0; r<n; ++r)
+    {
+      MRFEngine &e = job.chains[r];
+      e.SetModel(*this);	// shares the singleton table
+      e.threads = 1;
+      e.checkerboard = false;
+      e.verify = false;
+      e.width = width;
+      e.height = height;
+      e.in_image_data.Copy(in_image_data);
+      e.classes.Copy(classes);
+      e.beta = beta;		// beta of the current level
+      e.T = (n > 1 ? T_min*pow(T0/T_min, (double)r/(n-1)) : T_min);
+      e.K = 0;
+      e.E = e.E_old = e.CalculateEnergy();
+      if (!gibbs && 256.0*no_regions*no_regions <= (double)width*height)
+	e.boltzmann_ratios = new double[256*no_regions*no_regions];
+      e.InitBoltzmann(gibbs);	// a chain keeps its temperature
+      job.replicas[r].best_E = e.E;
+      job.replicas[r].best.Copy(classes);
+    }
+
+  K = 0;
+  T = T_min;
+  E = best_E = job.chains[0].E;
+  for (round=0; ; ++round)
+    {
+      for (r=0; r<n; ++r) job.chains[r].changes = 0;
+      if (tp != NULL)
+	tp->Run(ReplicaBand<S>, &job);
+      else
+	ReplicaBand<S>(&job, 0);
+      changes = 0;
+      for (r=0; r<n; ++r) changes += job.chains[r].changes;
+
+      /* exchanges between rungs (r-1, r)
+       */
+      long exchanges = 0;
+      for (r=1+round%2; r<n; r+=2)
+	{
+	  MRFEngine &a = job.chains[r-1], &b = job.chains[r];
+	  double delta = (1.0/a.T - 1.0/b.T)*(a.E - b.E);
+	  if (delta >= 0.0 || rg.Random() < exp(delta))
+	    {
+	      ++exchanges;
+	      a.classes.Swap(b.classes);
+	      double e = a.E;
+	      a.E = a.E_old = b.E;
+	      b.E = b.E_old = e;
+	    }
+	}
+
+      /* best labeling so far
+       */
+      double previous = best_E;
+      int best = -1;
+      for (r=0; r<n; ++r)
+	if (job.replicas[r].best_E < best_E)
+	  {
+	    best_E = job.replicas[r].best_E;
+	    best = r;
+	  }
+      if (best >= 0) classes.Copy(job.replicas[best].best);
+      E = best_E;
+      K = job.chains[0].K;
+      RecordSweep(K, exchanges); // T is that of the coldest chain
+      OnIteration();  // display current labeling
+      if (previous - best_E > t) idle = 0;
+      else if (++idle >= n) break;
+    }
+  if (verify)			// errors of the incremental energies
+    for (r=0; r<n; ++r)
+      {
+	MRFEngine &e = job.chains[r];
+	double error = fabs(e.CalculateEnergy() - e.E);
+	if (error > energy_error) energy_error = error;
+      }
+  T = T0;			// the next level uses the same ladder
+
+  for (r=0; r<n; ++r)
+    {
+      delete [] job.chains[r].boltzmann_ratios;
+      job.chains[r].boltzmann_ratios = NULL;
+    }
+  delete tp;
+}
+
+
+/* Alpha-expansion graph cut, see Y. Boykov, O. Veksler, R. Zabih:
+ * Fast Approximate Energy Minimization via Graph Cuts. IEEE Trans.
+ * PAMI 23(11), 2001.
+ *
+ * An expansion move lets every site either keep its label or switch
+ * to a given label alpha. The best of these 2^(width*height) moves is
+ * found exactly as a minimum cut of a grid graph, where sites on the
+ * sink side take the label alpha. A cycle tries every label once;
+ * cycles are repeated until the energy decrease is below t. Usually
+ * a few cycles are enough, and the result is within a factor of 2 of
+ * the global minimum. The Potts doubleton potential is a metric only
+ * if beta >= 0, otherwise the moves are approximated.
+ */
+double MRFEngine::ExpansionMove(GridMaxflow &graph, int alpha)
+{
+  int i, j, p;
+  int lp, lq;
+  double w = 2.0*beta;	// doubleton potential = w*(lp != lq) - beta
+  double A, B, C;	// potential of (keep,keep), (keep,alpha) and
+			// (alpha,keep) (that of (alpha,alpha) is 0)
+
+  graph.Init(width, height);
+  for (i=0; i<height; ++i)
+    for (j=0; j<width; ++j)
+      {
+	p = i*width + j;
+	lp = classes(i,j);
+	graph.AddTerminal(p, Singleton(i,j,alpha), Singleton(i,j,lp));
+	for (int d=GridMaxflow::EAST; d<=GridMaxflow::SOUTH; ++d)
+	  {
+	    if (d == GridMaxflow::EAST ? j == width-1 : i == height-1)
+	      continue;
+	    lq = (d == GridMaxflow::EAST ? classes(i,j+1) : classes(i+1,j));
+	    A = (lp != lq ? w : 0.0);
+	    B = (lp != alpha ? w : 0.0);
+	    C = (alpha != lq ? w : 0.0);
+	    /* A + (C-A)*xp - C*xq + (B+C-A)*(1-xp)*xq, where x = 1
+	     * means alpha
+	     */
+	    graph.AddTerminal(p, C-A, 0.0);
+	    graph.AddTerminal(p + (d == GridMaxflow::EAST ? 1 : width),
+			      0.0, C);
+	    graph.AddEdge(p, d, (B+C-A > 0.0 ? B+C-A : 0.0), 0.0);
+	  }
+      }
+  graph.Maxflow();
+  /* apply the move; the energy changes of the sites add up to that of
+   * the move
+   */
+  double dE = 0.0;
+  for (i=0; i<height; ++i)
+    for (j=0; j<width; ++j)
+      if (graph.IsSink(i*width + j) && classes(i,j) != alpha)
+	{
+	  dE += LocalEnergy(i, j, alpha) - LocalEnergy(i, j, classes(i,j));
+	  classes(i,j) = alpha;
+	  ++changes;
+	}
+  return dE;
+}
+
+
+void MRFEngine::RunGraphCut()
+{
+  GridMaxflow graph;
+  double summa_deltaE;
+  double dE;
+
+  K = 0;
+  E_old = CalculateEnergy();
+
+  do
+    {
+      dE = 0.0;
+      changes = 0;
+      long expansions = 0;	// moves which changed labels
+      for (int alpha=0; alpha<no_regions; ++alpha)
+	{
+	  long before = changes;
+	  dE += ExpansionMove(graph, alpha);
+	  expansions += (changes > before);
+	}
+      E = VerifyEnergy(E_old + dE);
+      summa_deltaE = fabs(E_old-E);
+      E_old = E;
+      RecordSweep(K+1, expansions);
+
+      ++K;	      // advance iteration counter (cycles)
+      OnIteration();  // display current labeling
+    } while (summa_deltaE > t); // stop when energy change is small
+}
+
+
+/* Loopy belief propagation and TRW-S (see beliefprop.h)
+ *
+ * Both pass min-sum messages of the same energy: the singletons as
+ * unary costs and the Potts doubletons as 2*beta*(lp != lq), which
+ * differs from them by a constant. An iteration is a checkerboard
+ * sweep of BP (parallel like the other checkerboard sweeps) or a
+ * forward and a backward pass of TRW-S (serial by nature), followed
+ * by decoding a labeling. Neither decreases the energy of the
+ * labeling monotonically, so the result is the lowest energy labeling
+ * seen (starting with the initial one), and the iterations stop when
+ * BP_PATIENCE of them in a row have not improved it by more than t.
+ * The messages start from 0 on every level.
+ */
+#define BP_PATIENCE 5		// iterations without improvement
+#define BP_MAX_ITERATIONS 1000
+
+
+void MRFEngine::RunMessagePassing(bool trws)
+{
+  GridBP bp;
+  ImageBuffer<label_t> best;	// lowest energy labeling
+  double best_E;
+  int idle = 0;			// iterations without improvement
+  int i, j, l;
+
+  ThreadPool *tp = (trws ? NULL : GetPool());
+  bp.Init(width, height, no_regions, (float)(2.0*beta),
+	  tp != NULL ? tp->GetNoThreads() : 1);
+  for (i=0; i<height; ++i)
+    for (j=0; j<width; ++j)
+      {
+	float *u = bp.Unary(i*width + j);
+	for (l=0; l<no_regions; ++l) u[l] = (float)Singleton(i, j, l);
+      }
+
+  K = 0;
+  E = E_old = best_E = CalculateEnergy();
+  best.Copy(classes);
+
+  do
+    {
+      if (trws)
+	{
+	  bp.ForwardPass();
+	  bp.BackwardPass();
+	}
+      else
+	bp.Sweep(tp);
+      changes = bp.Decode(&classes(0,0), classes.GetStride());
+      E = CalculateEnergy();
+      RecordSweep(K+1, changes);
+
+      ++K;	      // advance iteration counter
+      OnIteration();  // display current labeling
+      if (best_E - E > t) idle = 0;
+      else ++idle;
+      if (E < best_E)
+	{
+	  best_E = E;
+	  best.Copy(classes);
+	}
+    } while (idle < BP_PATIENCE && K < BP_MAX_ITERATIONS);
+
+  if (E > best_E)
+    {
+      classes.Copy(best);
+      E = best_E;
+    }
+  E_old = E;
+}
+
+
+void MRFEngine::Metropolis(bool mmd)
+{
+  Optimize(mmd ? MMD : METROPOLIS);
+}
+
+
+void MRFEngine::ICM(bool checkerboard)
+{
+  Optimize(checkerboard ? ICM_CHECKERBOARD : ICM_RASTER);
+}
+
+
+void MRFEngine::ICMWorklist()
+{
+  Optimize(ICM_WORKLIST);
+}
+
+
+void MRFEngine::Gibbs()
+{
+  Optimize(GIBBS);
+}
+
+
+void MRFEngine::GraphCut()
+{
+  Optimize(GRAPHCUT);
+}
+
+
+void MRFEngine::SwendsenWang()
+{
+  Optimize(SWENDSEN_WANG);
+}
+
+
+void MRFEngine::MessagePassing(bool trws)
+{
+  Optimize(trws ? TRWS : BP);
+}
+
+
+void MRFEngine::RunOptimizer(int method)
+{
+  changes = 0;
+  if (telemetry != NULL) telemetry->Lap();
+  switch (neighbourhood)
+    {
+    case 8: RunOptimizer<Neighbourhood8>(method); break;
+    case 24: RunOptimizer<Neighbourhood24>(method); break;
+    default: RunOptimizer<Neighbourhood4>(method);
+    }
+}
+
+
+template <class S>
+void MRFEngine::RunOptimizer(int method)
+{
+  switch (method)
+    {
+    case METROPOLIS:
+      if (replicas != 1)
+	RunReplicaExchange<S>(false);
+      else
+	RunMetropolis<S>(false);
+      break;
+    case MMD: RunMetropolis<S>(true); break;
+    case ICM_RASTER: RunICM<S>(false); break;
+    case ICM_CHECKERBOARD: RunICM<S>(true); break;
+    case GIBBS:
+      if (replicas != 1)
+	RunReplicaExchange<S>(true);
+      else
+	RunGibbs<S>();
+      break;
+    case GRAPHCUT:		// the graph is 4-connected
+      if (S::size == 4)
+	RunGraphCut();
+      else
+	RunICM<S>(false);
+      break;
+    case ICM_WORKLIST: RunICMWorklist<S>(); break;
+    case SWENDSEN_WANG: RunSwendsenWang<S>(); break;
+    case BP:			// so are the messages
+    case TRWS:
+      if (S::size == 4)
+	RunMessagePassing(method == TRWS);
+      else
+	RunICM<S>(false);
+      break;
+    }
+}
+
+
+/* Multi-resolution optimization
+ *
+ * Level 0 is the input image, level l+1 is level l reduced by 2 in
+ * both directions (each pixel is the mean of a 2x2 block). The
+ * optimizer is first run on the coarsest level starting from the
+ * maximum likelihood labeling. Its result, enlarged to the next finer
+ * level, is the initial labeling there, and so on. Since the coarse
+ * levels are small and the initial labeling of the finer levels is
+ * already close to the optimum, only a few sweeps are needed at full
+ * resolution.
+ *
+ * A site of level l stands for a 2^l x 2^l block of pixels: its
+ * singleton potential sums up 4^l pixels while only 2^l cliques cross
+ * each side of the block. Hence beta/2^l is used at level l. Each
+ * level has its own annealing schedule: the coarsest one starts from
+ * T0, the others from the temperature the previous level stopped at.
+ */
+#define MIN_LEVEL_SIZE 16	// levels are not made smaller than this
+
+
+/* Reduces src by 2 in both directions into dst
+ */
+static void Downsample(ImageBuffer<unsigned char> &src,
+		       ImageBuffer<unsigned char> &dst)
+{
+  int w = src.GetWidth(), h = src.GetHeight();
+  int i, j;
+
+  dst.Resize((w+1)/2, (h+1)/2);
+  for (i=0; i<dst.GetHeight(); ++i)
+    {
+      const unsigned char *r0 = src.Row(2*i);
+      const unsigned char *r1 = src.Row(2*i+1 < h ? 2*i+1 : 2*i);
+      unsigned char *d = dst.Row(i);
+      for (j=0; j<dst.GetWidth(); ++j)
+	{
+	  int j1 = (2*j+1 < w ? 2*j+1 : 2*j);
+	  d[j] = (r0[2*j] + r0[j1] + r1[2*j] + r1[j1] + 2) / 4;
+	}
+    }
+}
+
+
+void MRFEngine::Optimize(int method)
+{
+  int n;		// number of levels
+  double beta0 = beta, T00 = T0;
+  ImageBuffer<unsigned char> *images; // images of the levels 1..n-1
+  ImageBuffer<label_t> coarse;	      // labeling of the previous level
+
+  for (n=1; n<levels && (width >> n) >= MIN_LEVEL_SIZE &&
+	 (height >> n) >= MIN_LEVEL_SIZE; ++n) ;
+  level = 0;
+  agreement[0] = agreement[1] = 0;
+  if (n == 1)
+    {
+      InitOutImage();
+      RunOptimizer(method);
+      return;
+    }
+
+  images = new ImageBuffer<unsigned char>[n];
+  Downsample(in_image_data, images[1]);
+  for (level=2; level<n; ++level)
+    Downsample(images[level-1], images[level]);
+
+  for (level=n-1; level>=0; --level)
+    {
+      if (level > 0)
+	in_image_data.Swap(images[level]);
+      width = in_image_data.GetWidth();
+      height = in_image_data.GetHeight();
+      beta = ldexp(beta0, -level);
+      if (level == n-1)
+	InitOutImage();
+      else
+	{
+	  /* enlarge the labeling of the coarser level
+	   */
+	  classes.Resize(width, height);
+	  for (int i=0; i<height; ++i)
+	    for (int j=0; j<width; ++j)
+	      classes(i,j) = coarse(i/2, j/2);
+	}
+      RunOptimizer(method);
+      T0 = T;		// next level continues from here
+      if (level > 0)
+	{
+	  in_image_data.Swap(images[level]);
+	  coarse.Swap(classes);
+	}
+    }
+  level = 0;
+  beta = beta0;
+  T0 = T00;
+  delete [] images;
+}
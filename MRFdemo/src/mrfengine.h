@@ -0,0 +1,387 @@
+/******************************************************************
+ * Modul name : mrfengine.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * GUI-free core of the intensity-based MRF segmentation: the
+ * Gaussian singleton + Potts doubleton energy and the
+ * optimization algorithms (Metropolis, MMD, ICM, Gibbs sampler,
+ * graph cut, belief propagation).
+ * The wxWidgets demo (mrf.cpp) and the command line tool
+ * (mrfseg.cpp) are both thin front-ends of this class.
+ *
+ *****************************************************************/
+
+#ifndef MRFENGINE_H
+#define MRFENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imagebuffer.h"
+#include "neighbourhood.h"
+
+class TRandomMersenne;
+class TRandomPhilox;
+class ThreadPool;
+class GridMaxflow;
+class BitBoard;
+class Telemetry;
+struct SweepJob;
+struct ClusterJob;
+struct ReplicaJob;
+struct ICMArgs;
+
+/* MRFEngine class: it holds the input intensities, the class
+ * parameters and the current labeling, and runs the optimizers on
+ * them. It does not know anything about windows or image files.
+ */
+class MRFEngine
+{
+public:
+  MRFEngine();
+  virtual ~MRFEngine();
+
+  /* copies the first channel of an interleaved 8 bit image
+   * (channels=1 for gray, 3 for RGB data as returned by wxImage)
+   */
+  void SetImage(const unsigned char *data, int w, int h, int channels=1);
+  bool HasImage() { return !in_image_data.IsEmpty(); }
+  int GetWidth() { return width; }
+  int GetHeight() { return height; }
+
+  bool SetNoRegions(int n);	      	// sets the number of regions,
+					// allocates/frees memory for
+					// means and variances. False
+					// if n > MRF_MAX_REGIONS
+  int GetNoRegions() { return no_regions; }
+  void SetClass(int label, double m, double v); // sets the Gaussian
+						// parameters of a class
+  void SetModel(MRFEngine &model);	// copies the class parameters and
+					// all settings of model, and
+					// shares its singleton table
+					// (model must outlive this engine
+					// and must not run meanwhile)
+  bool SetNeighbourhood(int n);		// 4 (default), 8 or 24 neighbours
+					// (3x3 or 5x5 window); false
+					// otherwise. With 8 and 24 the
+					// sweeps are serial raster scans,
+					// ICM_CHECKERBOARD, GRAPHCUT, BP
+					// and TRWS run ICM_RASTER
+  int GetNeighbourhood() { return neighbourhood; }
+  double GetMean(int label) { return mean[label]; }
+  double GetVariance(int label) { return variance[label]; }
+  void SetBeta(double b) { beta = b; }
+  void SetT(double x) { t = x; }
+  void SetT0(double t) { T0 = t; }
+  void SetC(double x) { c = x; }
+  void SetAdaptive(bool on) { adaptive = on; } // adaptive temperature
+					// schedule of METROPOLIS, MMD
+					// and GIBBS driven by the
+					// acceptance rate, stops when
+					// the labeling freezes (see
+					// AnnealingSchedule). Default:
+					// T(n+1)=c*T(n)
+  void SetAlpha(double x) { alpha = x; }
+  void SetSeed(unsigned long s) { seed = s; fixed_seed = true; }
+  void SetThreads(int n) { threads = n; } // 1: raster scan (default),
+					  // otherwise checkerboard
+					  // sweeps on n threads
+					  // (0: one per CPU core)
+  void SetCheckerboard(bool on) { checkerboard = on; } // checkerboard
+					  // sweeps even on one thread
+  enum { MERSENNE, PHILOX };		  // random number generators
+  void SetGenerator(int g) { generator = g; } // MERSENNE (default) or
+					  // PHILOX. The latter makes
+					  // the samplers' results
+					  // independent of the number
+					  // of threads.
+  void SetSIMD(bool on) { simd = on; } // use vector kernels if the
+				       // CPU supports them (default)
+  void SetReplicas(int n, double Tmin)	// replica exchange: METROPOLIS
+  {					// and GIBBS run n chains (0:
+    replicas = n;			// one per core) at temperatures
+    T_min = Tmin;			// from T0 down to Tmin, see
+  }					// RunReplicaExchange() (1: a
+					// single annealed chain, default)
+  void SetBitboard(bool on) { bitboard = on; } // two-class Metropolis
+					// and MMD on bit-packed labels
+					// in checkerboard order (see
+					// RunBitboard())
+  void SetVerify(bool on) { verify = on; } // recompute the global
+					// energy after each sweep
+					// (see VerifyEnergy()) and
+					// check the decisions of
+					// reduced precision
+  enum { FLOAT64, FLOAT32, FIXED16 };	// precision of the decisions
+  void SetPrecision(int p) { precision = p; } // FLOAT64 (default),
+					// FLOAT32 or FIXED16 (16 bit
+					// fixed point) for MMD and
+					// checkerboard ICM; the
+					// energy is always double
+  double GetAgreement()			// fraction of the reduced
+  {					// precision decisions that
+    return agreement[0] > 0 ?		// agree with double precision
+      (double)agreement[1]/agreement[0] : 1.0; // (measured if
+  }					// SetVerify() is on)
+  double GetEnergyError() { return energy_error; } // largest error of
+					// the incremental energy
+  void SetTelemetry(Telemetry *t) { telemetry = t; } // records every
+					// sweep in t (NULL: none,
+					// default); not copied by
+					// SetModel()
+  void SetLevels(int n) { levels = n; } // number of resolution levels
+					// (1: full resolution only)
+  int GetLevel() { return level; }	// level being optimized
+					// (0: full resolution)
+  int GetK() { return K; }
+  double GetT() { return T; }
+  double GetE() { return E; }
+  double GetAcceptance()		// fraction of the labels changed
+  {					// by the last sweep
+    return width > 0 ? (double)changes/((double)width*height) : 0.0;
+  }
+
+  bool HasLabels() { return !classes.IsEmpty(); } // TRUE if a labeling
+						  // exists
+  int GetLabel(int i, int j) { return classes(i,j); }
+
+  bool CalculateMeanAndVariance(int region,   // computes mean and
+				int x, int y, // variance of the given
+				int w, int h);// training rectangle.
+					      // False if there is no
+					      // image, or if the rectangle
+					      // is not inside it or has
+					      // less than 2 pixels
+  bool EstimateClasses();		      // estimates the parameters
+					      // of all classes from the
+					      // histogram of the image
+					      // (k-means + EM); false if
+					      // there is no image
+  double UpdateClasses();		      // re-estimates them from the
+					      // current labeling, returns
+					      // the largest change
+  int OptimizeUnsupervised(int method,	      // EstimateClasses(), then
+			   int rounds=10);    // Optimize() and
+					      // UpdateClasses() in turn
+					      // until the parameters
+					      // settle. Returns the # of
+					      // rounds
+  double CalculateEnergy();                   // computes global energy
+					      // based on the current
+					      // lableing in data
+  double LocalEnergy(int i, int j, int label);// computes the local
+					      // energy at site (i,j)
+					      // assuming "label" has
+					      // been assigned to it.
+
+  void Metropolis(bool mmd=false);  // executes Metropolis or MMD (if mmd=true)
+  void ICM(bool checkerboard=false); // executes ICM (in checkerboard
+				     // order with vectorized kernels if
+				     // checkerboard=true)
+  void ICMWorklist();		    // executes ICM revisiting only the
+				    // sites whose neighbours changed
+  void Gibbs();			    // executes Gibbs sampler
+  void GraphCut();		    // executes alpha-expansion graph cut
+  void SwendsenWang();		    // executes Swendsen-Wang cluster
+				    // sampler (needs beta > 0,
+				    // otherwise runs Gibbs sampler)
+  void MessagePassing(bool trws=false); // executes loopy belief
+				    // propagation (TRW-S if trws=true)
+  enum { METROPOLIS, MMD, ICM_RASTER, ICM_CHECKERBOARD, GIBBS, GRAPHCUT,
+	 ICM_WORKLIST, SWENDSEN_WANG, BP, TRWS };
+  void Optimize(int method);	    // executes one of the above, coarse
+				    // to fine if SetLevels() > 1
+
+protected:
+  /* Called after each sweep of the optimizers. Front-ends override
+   * it to display (or log) the current labeling.
+   */
+  virtual void OnIteration() {}
+
+  int width, height;		    // width and height of the image
+  int no_regions;	            // number of regions for Gaussian
+				    // parameter computation
+  double beta;                      // strength of second order clique potential
+  double t;			    // Stop criteraia threshold: stop
+				    // if (deltaE < t)
+  double T0;		            // Initial temperature (not used by ICM)
+
+  double c;			    // Temperature scheduler's factor:
+				    // T(n+1)=c*T(n).
+  double alpha;		            // alpha value for MMD
+  double *mean;			    // computed mean values and
+  double *variance;		    // variances for each region
+  double *singletons;		    // singleton potential of each
+				    // (intensity, label) pair, see
+				    // InitSingletons()
+  bool shared_singletons;	    // singletons belongs to the model
+				    // engine, see SetModel()
+  double *boltzmann_singletons;	    // Boltzmann factors at the current
+  double boltzmann_doubletons[MRF_MAX_NEIGHBOURS+1]; // temperature, see
+  double *boltzmann_ratios;	    // InitBoltzmann() (NULL if not
+  double boltzmann_pairs[2*MRF_MAX_NEIGHBOURS+1]; // tabulated)
+  bool use_ratios;		    // the tables above are exact at T
+  int precision;		    // see SetPrecision()
+  float *singletons32;		    // reduced precision potentials,
+  float doubletons32[9];	    // see InitReduced()
+  short *singletons16;
+  short doubletons16[9];
+  double scale16;		    // fixed point units per energy unit
+  long agreement[2];		    // see GetAgreement(): decisions and
+				    // those agreeing with double
+  double E;			    // current global energy
+  double E_old;			    // global energy in the prvious iteration
+  double T;			    // current temperature
+  int K;			    // current iteration #
+  long changes;			    // labels changed in the current sweep
+  ImageBuffer<label_t> classes;	    // this is the labeled image
+  ImageBuffer<unsigned char> in_image_data; // Intensity values of the
+					    // input image
+  ImageBuffer<uint64_t> moments[2];  // summed-area tables of the
+				    // intensities and their squares
+				    // (empty until needed, see
+				    // InitMoments())
+  unsigned long seed;		    // seed of the random number generator
+  bool fixed_seed;		    // if false, time(0) is used as seed
+  int threads;			    // number of threads, see SetThreads()
+  int levels;			    // see SetLevels()
+  int level;			    // current level, see GetLevel()
+  ThreadPool *pool;		    // worker threads (NULL if serial)
+  bool checkerboard;		    // see SetCheckerboard()
+  bool verify;			    // see SetVerify()
+  double energy_error;		    // see GetEnergyError()
+  bool simd;			    // see SetSIMD()
+  bool bitboard;		    // see SetBitboard()
+  int generator;		    // see SetGenerator()
+  int neighbourhood;		    // see SetNeighbourhood()
+  int replicas;			    // see SetReplicas()
+  double T_min;
+  bool adaptive;		    // see SetAdaptive()
+  Telemetry *telemetry;		    // see SetTelemetry()
+
+  void InitSingletons();	   // fills the singletons table
+  void UnshareSingletons();	   // see SetModel()
+  void InitMoments();		   // fills moments
+  void InitReduced(bool clip);	   // fills the reduced precision
+				   // tables (if precision is reduced)
+  void InitBoltzmann(bool gibbs);  // fills the Boltzmann factor
+				   // tables for temperature T
+  void InitOutImage();
+  unsigned long Seed();		   // seed for the next run
+  double VerifyEnergy(double e);   // e or the recomputed energy
+  void RecordSweep(int sweep,	   // see SetTelemetry()
+		   long accepted);
+  double CalculateEnergy(int i0, int i1, // energy of a window
+			 int j0, int j1);
+  ThreadPool *GetPool();	   // NULL if the sweeps are serial
+  void RunOptimizer(int method);   // runs an optimizer at the current
+				   // level, starting from the current
+				   // labeling
+
+  /* The optimizers and the energy functions below are templates of
+   * the neighbourhood system S (a stencil of neighbourhood.h);
+   * RunOptimizer() selects the instance. The checkerboard sweeps, the
+   * vector kernels, the bit-packed sweeps, the graph cut and the
+   * message passing exist for Neighbourhood4 only.
+   */
+  template <class S> void RunOptimizer(int method);
+  template <class S> void RunMetropolis(bool mmd);
+  template <class S> void RunICM(bool checkerboard);
+  template <class S> void RunICMWorklist();
+  template <class S> void RunGibbs();
+  template <class S> void RunSwendsenWang();
+  template <class S> void RunReplicaExchange(bool gibbs);
+  void RunBitboard(bool mmd);
+  void RunGraphCut();
+  void RunMessagePassing(bool trws);
+  template <class S>
+  double CalculateEnergy(int i0, int i1, int j0, int j1);
+  template <class S>
+  double LocalEnergy(int i, int j, int label);
+  double Singleton(int i, int j, int label) // singleton potential at
+  {					     // site (i,j) having a label
+    return singletons[in_image_data(i,j)*no_regions+label]; // "label"
+  }
+  template <class S>
+  double Doubleton(int i, int j, int label); // computes doubleton
+					     // potential at site
+					     // (i,j) having a label "label"
+  template <class S>
+  int Doubletons(int i, int j,		     // computes the doubleton
+		 int label1, int label2,     // potentials of two labels
+		 double &energy1,	     // at site (i,j) in a single
+		 double &energy2);	     // pass over the neighbours.
+					     // Returns the # of neighbours
+					     // labeled label1 minus the #
+					     // of those labeled label2
+
+  /* Single site updates shared by the raster scan and the
+   * checkerboard sweeps. RNG is TRandomMersenne or TRandomPhilox.
+   */
+  template <class S, class RNG>
+  bool MetropolisStep(int i, int j,	// returns true if the proposed
+		      RNG &rg,		// label has been accepted;
+		      bool mmd, double kszi,  // Eq and Er are the local
+		      double &Eq, double &Er, // energies of the old and
+		      long *counts);	// the new label. counts: see
+					// agreement (NULL: not counted)
+  template <class S, class RNG>
+  double GibbsStep(int i, int j, RNG &rg, // returns the energy change;
+		   double *Ek);		// Ek: no_regions work space
+  template <class S>
+  bool ICMStep(int i, int j,		// returns true if the label has
+	       double &dE);		// changed, adds the energy change
+					// to dE
+
+  /* Raster scan sweeps of the sites in rows [i0,i1) and columns
+   * [j0,j1); the sites outside are not changed.
+   */
+  template <class S, class RNG>
+  void MetropolisSweep(RNG &rg, bool mmd, double kszi,
+		       double &summa_deltaE,
+		       int i0, int i1, int j0, int j1);
+  template <class S, class RNG>
+  void GibbsSweep(RNG &rg, double *Ek, double &dE, // dE: energy change
+		  int i0, int i1, int j0, int j1);
+  template <class S>
+  void ICMSweep(double &dE, int i0, int i1, int j0, int j1);
+  template <class RNG>
+  void BitboardSweep(BitBoard &board, RNG &rg,
+		     const double *energy,  // see RunBitboard()
+		     const double *accept,
+		     double &summa_deltaE, double &dE);
+
+  /* Checkerboard sweeps: update one color of the checkerboard within
+   * the row band of a thread (ThreadPool jobs, job is a SweepJob)
+   */
+  SweepJob *NewSweepJob();		// NULL if raster scan is used
+  template <class RNG>
+  int MetropolisRows(SweepJob *job, int i0, int i1, RNG &rg,
+		     long *counts);
+  template <class RNG>
+  int GibbsRows(SweepJob *job, int i0, int i1, RNG &rg, double *Ek);
+  double ExpansionMove(GridMaxflow &graph, // see RunGraphCut(),
+		       int alpha);	   // returns the energy change
+  static void MetropolisBand(void *job, int thread);
+  static void GibbsBand(void *job, int thread);
+  static void ICMBand(void *job, int thread);
+
+  /* Swendsen-Wang: the phases of a sweep within the row band of a
+   * thread (job is a ClusterJob)
+   */
+  template <class S, class RNG>
+  void BondRows(ClusterJob *job, int i0, int i1, RNG &rg, int thread);
+  template <class S>
+  static void ClusterBand(void *job, int thread);
+
+  /* Replica exchange: the sweeps of a chain between two exchanges
+   * (this is the engine of chain r, job is a ReplicaJob)
+   */
+  template <class S, class RNG>
+  void ReplicaSweeps(ReplicaJob *job, int r, RNG &rg);
+  template <class S>
+  static void ReplicaBand(void *job, int thread);
+};
+
+
+#endif
@@ -0,0 +1,544 @@
+/******************************************************************
+ * Modul name : mrfseg.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Command line front-end of the MRF segmentation engine. It reads a
+ * PGM/PPM image, takes the class parameters either as Gaussian
+ * parameters or as training rectangles, runs the chosen optimizer
+ * and writes the label map as a PGM image (pixel value = label).
+ * No display toolkit is needed, hence it can be used for batch
+ * processing on headless machines.
+ *
+ *****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrfengine.h"
+#include "pnmio.h"
+#include "tiled.h"
+#include "batch.h"
+#include "telemetry.h"
+
+/* Timer classes
+ */
+#include "CKProcessTimeCounter.h"
+
+
+static bool verbose = false;
+
+
+/* Engine printing the state of the optimizer after each sweep
+ */
+template <class Engine>
+class Verbose: public Engine
+{
+protected:
+  virtual void OnIteration()
+  {
+    if (verbose)
+      fprintf(stderr, "level = %d\tK = %d\tT = %g\tE = %g\tA = %g\n",
+	      this->level, this->K, this->T, this->E,
+	      this->GetAcceptance());
+  }
+};
+
+
+static void Usage()
+{
+  fprintf(stderr,
+	  "usage: mrfseg [options] input.pgm output.pgm\n"
+	  "       mrfseg [options] -j jobs input1 output1 input2 output2 ...\n"
+	  "  -m method    metropolis, mmd, icm, icm-cb, icm-wl, gibbs, sw,\n"
+	  "               graphcut, bp or trws (default: metropolis). icm-cb\n"
+	  "               is ICM in checkerboard order using vector\n"
+	  "               instructions, icm-wl revisits only the sites whose\n"
+	  "               neighbours changed (it stops at a local minimum, t\n"
+	  "               is not used), sw is the Swendsen-Wang cluster\n"
+	  "               sampler (needs beta > 0), graphcut is\n"
+	  "               alpha-expansion (needs beta >= 0), bp is loopy\n"
+	  "               belief propagation (checkerboard-parallel) and\n"
+	  "               trws is sequential tree-reweighted message passing\n"
+	  "  -g mean,var  Gaussian parameters of the next class\n"
+	  "  -r x,y,w,h   training rectangle of the next class\n"
+	  "  -e n         unsupervised: estimates the parameters of n classes\n"
+	  "               from the histogram (k-means + EM), then re-estimates\n"
+	  "               them from the segmentation until they settle (not\n"
+	  "               with -x; with -j the first image is used once)\n"
+	  "  -b beta      weight of doubleton potentials (default: 0.9)\n"
+	  "  -N n         neighbourhood of the doubletons: 4 (default), 8 or\n"
+	  "               24 (3x3 or 5x5 window; not with graphcut, bp, trws\n"
+	  "               and -x, icm-cb runs as icm)\n"
+	  "  -t t         stop when the energy change is below t (default: 0.05)\n"
+	  "  -T T0        initial temperature (default: 4.0)\n"
+	  "  -c c         temperature scheduler, T(n+1) = c*T(n) (default: 0.98)\n"
+	  "  -A           adaptive temperature schedule for metropolis, mmd\n"
+	  "               and gibbs: the acceptance rate follows the curve of\n"
+	  "               -c, and the run stops when the labeling freezes\n"
+	  "               (not with -E)\n"
+	  "  -a alpha     MMD's alpha (default: 0.1)\n"
+	  "  -s seed      random seed (default: current time)\n"
+	  "  -E n[,Tmin]  replica exchange for metropolis and gibbs: n chains\n"
+	  "               (0: one per core) at fixed temperatures from T0\n"
+	  "               down to Tmin (default: 0.1), c is not used; the\n"
+	  "               result is the best labeling found (not with -x)\n"
+	  "  -p threads   checkerboard-parallel Metropolis/MMD/Gibbs sweeps\n"
+	  "               on the given number of threads (0: all cores,\n"
+	  "               default: 1 = serial raster scan)\n"
+	  "  -C           checkerboard sweeps even on a single thread\n"
+	  "  -B           two-class metropolis/mmd on bit-packed labels\n"
+	  "               (checkerboard order on a single thread; not with\n"
+	  "               -N, -x and -E)\n"
+	  "  -R generator random number generator: mersenne (default) or\n"
+	  "               philox (counter-based, results are independent of\n"
+	  "               the number of threads with -C or -p > 1)\n"
+	  "  -l levels    coarse-to-fine optimization on the given number of\n"
+	  "               resolution levels (default: 1 = full resolution;\n"
+	  "               not with sw, bp and trws)\n"
+	  "  -x size      out-of-core segmentation in tiles of size x size\n"
+	  "               pixels, for images which don't fit in the memory\n"
+	  "               (metropolis, mmd, icm and gibbs in raster scan order\n"
+	  "               only; -p, -C, -R, -l and -V are ignored)\n"
+	  "  -j jobs      batch mode: segments the given pairs of images with\n"
+	  "               the same class parameters (rectangles refer to the\n"
+	  "               first image), jobs at the same time (0: one per\n"
+	  "               core), and reports the images/sec\n"
+	  "  -S           don't use vector instructions (AVX2/AVX-512)\n"
+	  "  -P precision decisions of mmd and icm-cb in float64 (default),\n"
+	  "               float32 or int16 (fixed point; not with -B, and\n"
+	  "               icm-cb only with -N 4)\n"
+	  "  -M file      writes the temperature, energy, accepted moves,\n"
+	  "               changed labels and times of each sweep to file\n"
+	  "               (JSON if its name ends with .json, CSV otherwise;\n"
+	  "               the last 100000 sweeps; not with -j)\n"
+	  "  -v           print K, T, E and the acceptance after each\n"
+	  "               iteration\n"
+	  "  -V           verify the incrementally computed energy after each\n"
+	  "               iteration and print its largest error (and the\n"
+	  "               agreement of -P float32/int16 with float64)\n"
+	  "Classes are given by repeating -g and/or -r, one per class,\n"
+	  "or estimated with -e.\n"
+	  "The output pixel values are the class labels 0..n-1.\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *method = "metropolis";
+  const char *in_name = NULL, *out_name = NULL;
+  const char **files = new const char*[argc]; // input & output names
+  int no_files = 0;
+  int jobs = -1;		// -1: a single image, no batch
+  double beta = 0.9, t = 0.05, T0 = 4.0, c = 0.98, alpha = 0.1;
+  Verbose<MRFEngine> in_core;
+  Verbose<TiledEngine> tiled;
+  MRFEngine *engine;
+  int tile_size = 0;		// 0: the whole image is in the memory
+  bool simd = true, verify = false, checkerboard = false, fixed_seed = false;
+  bool bitboard = false, adaptive = false;
+  unsigned long seed = 0;
+  int threads = 1, levels = 1, generator = MRFEngine::MERSENNE;
+  int precision = MRFEngine::FLOAT64;
+  int neighbourhood = 4;
+  int estimate = 0;		// number of classes to be estimated
+  int replicas = 1;
+  double T_min = 0.1;
+  const char *telemetry_name = NULL;
+  CKProcessTimeCounter timer("core"); // CPU timer
+  int i, j;
+
+  /* class parameters: either mean & variance (rect[4*k] == -1) or a
+   * training rectangle
+   */
+  int no_regions = 0;
+  double *gauss = new double[argc*2];
+  int *rect = new int[argc*4];
+
+  for (i=1; i<argc; ++i)
+    {
+      if (argv[i][0] != '-' || argv[i][1] == '\0')
+	{
+	  files[no_files++] = argv[i];
+	  continue;
+	}
+      if (strcmp(argv[i], "-v") == 0)
+	{
+	  verbose = true;
+	  continue;
+	}
+      if (strcmp(argv[i], "-S") == 0)
+	{
+	  simd = false;
+	  continue;
+	}
+      if (strcmp(argv[i], "-V") == 0)
+	{
+	  verify = true;
+	  continue;
+	}
+      if (strcmp(argv[i], "-C") == 0)
+	{
+	  checkerboard = true;
+	  continue;
+	}
+      if (strcmp(argv[i], "-B") == 0)
+	{
+	  bitboard = true;
+	  continue;
+	}
+      if (strcmp(argv[i], "-A") == 0)
+	{
+	  adaptive = true;
+	  continue;
+	}
+      if (i+1 >= argc || argv[i][2] != '\0') Usage();
+      const char *arg = argv[++i];
+      switch (argv[i-1][1])
+	{
+	case 'm': method = arg; break;
+	case 'b': beta = atof(arg); break;
+	case 't': t = atof(arg); break;
+	case 'T': T0 = atof(arg); break;
+	case 'c': c = atof(arg); break;
+	case 'a': alpha = atof(arg); break;
+	case 's':
+	  seed = strtoul(arg, NULL, 10);
+	  fixed_seed = true;
+	  break;
+	case 'p': threads = atoi(arg); break;
+	case 'l': levels = atoi(arg); break;
+	case 'N': neighbourhood = atoi(arg); break;
+	case 'M': telemetry_name = arg; break;
+	case 'E':
+	  if (sscanf(arg, "%d,%lf", &replicas, &T_min) < 1 || replicas < 0 ||
+	      T_min <= 0.0) Usage();
+	  break;
+	case 'e':
+	  estimate = atoi(arg);
+	  if (estimate < 2) Usage();
+	  break;
+	case 'x':
+	  if ((tile_size = atoi(arg)) < 1) Usage();
+	  break;
+	case 'j':
+	  if ((jobs = atoi(arg)) < 0) Usage();
+	  break;
+	case 'R':
+	  if (strcmp(arg, "philox") == 0)
+	    generator = MRFEngine::PHILOX;
+	  else if (strcmp(arg, "mersenne") == 0)
+	    generator = MRFEngine::MERSENNE;
+	  else
+	    Usage();
+	  break;
+	case 'P':
+	  if (strcmp(arg, "float64") == 0)
+	    precision = MRFEngine::FLOAT64;
+	  else if (strcmp(arg, "float32") == 0)
+	    precision = MRFEngine::FLOAT32;
+	  else if (strcmp(arg, "int16") == 0)
+	    precision = MRFEngine::FIXED16;
+	  else
+	    Usage();
+	  break;
+	case 'g':
+	  if (sscanf(arg, "%lf,%lf", &gauss[no_regions*2],
+		     &gauss[no_regions*2+1]) != 2) Usage();
+	  rect[no_regions*4] = -1;
+	  ++no_regions;
+	  break;
+	case 'r':
+	  if (sscanf(arg, "%d,%d,%d,%d", &rect[no_regions*4],
+		     &rect[no_regions*4+1], &rect[no_regions*4+2],
+		     &rect[no_regions*4+3]) != 4 ||
+	      rect[no_regions*4] < 0 || rect[no_regions*4+1] < 0 ||
+	      rect[no_regions*4+2] < 1 || rect[no_regions*4+3] < 1 ||
+	      rect[no_regions*4+2]*rect[no_regions*4+3] < 2) Usage();
+	  ++no_regions;
+	  break;
+	default:
+	  Usage();
+	}
+    }
+  if (no_files < 2 || no_files % 2 != 0 || (jobs < 0 && no_files != 2) ||
+      (jobs >= 0 && tile_size > 0) || (estimate > 0 && no_regions > 0) ||
+      (replicas != 1 && tile_size > 0) ||
+      (telemetry_name != NULL && jobs >= 0) ||
+      (estimate == 0 && no_regions < 2)) Usage();
+  if (estimate > 0 && tile_size > 0)
+    {
+      fprintf(stderr, "mrfseg: -e can't be used with -x\n");
+      return 1;
+    }
+  if (estimate > 0) no_regions = estimate;
+  in_name = files[0];
+  out_name = files[1];
+
+  /* method codes of MRFEngine::Optimize()
+   */
+  static const char *methods[] = { "metropolis", "mmd", "icm", "icm-cb",
+				   "icm-wl", "gibbs", "graphcut", "sw", "bp",
+				   "trws" };
+  static const int codes[] = { MRFEngine::METROPOLIS, MRFEngine::MMD,
+			       MRFEngine::ICM_RASTER,
+			       MRFEngine::ICM_CHECKERBOARD,
+			       MRFEngine::ICM_WORKLIST, MRFEngine::GIBBS,
+			       MRFEngine::GRAPHCUT, MRFEngine::SWENDSEN_WANG,
+			       MRFEngine::BP, MRFEngine::TRWS };
+  int code = -1;
+  for (i=0; i<10; ++i)
+    if (strcmp(method, methods[i]) == 0) code = codes[i];
+  if (code < 0) Usage();
+  if (tile_size > 0 && code != MRFEngine::METROPOLIS &&
+      code != MRFEngine::MMD && code != MRFEngine::ICM_RASTER &&
+      code != MRFEngine::GIBBS)
+    {
+      fprintf(stderr, "mrfseg: %s can't be used with -x\n", method);
+      return 1;
+    }
+  if (neighbourhood != 4 &&
+      (tile_size > 0 || code == MRFEngine::GRAPHCUT ||
+       code == MRFEngine::BP || code == MRFEngine::TRWS))
+    {
+      fprintf(stderr, "mrfseg: -N %d can't be used with %s\n",
+	      neighbourhood, tile_size > 0 ? "-x" : method);
+      return 1;
+    }
+  if (levels > 1 && (code == MRFEngine::SWENDSEN_WANG ||
+		     code == MRFEngine::BP || code == MRFEngine::TRWS))
+    {
+      fprintf(stderr, "mrfseg: -l can't be used with %s\n", method);
+      return 1;
+    }
+  if (replicas != 1 && code != MRFEngine::METROPOLIS &&
+      code != MRFEngine::GIBBS)
+    {
+      fprintf(stderr, "mrfseg: -E can't be used with %s\n", method);
+      return 1;
+    }
+  if (precision != MRFEngine::FLOAT64)
+    {
+      const char *conflict = NULL;
+      char buffer[32];
+      if (code != MRFEngine::MMD && code != MRFEngine::ICM_CHECKERBOARD)
+	conflict = method;
+      else if (code == MRFEngine::ICM_CHECKERBOARD && neighbourhood != 4)
+	{
+	  sprintf(buffer, "-N %d", neighbourhood);
+	  conflict = buffer;
+	}
+      else if (bitboard) conflict = "-B";
+      if (conflict != NULL)
+	{
+	  fprintf(stderr, "mrfseg: -P can't be used with %s\n", conflict);
+	  return 1;
+	}
+    }
+  if (adaptive)
+    {
+      const char *conflict = NULL;
+      if (code != MRFEngine::METROPOLIS && code != MRFEngine::MMD &&
+	  code != MRFEngine::GIBBS)
+	conflict = method;
+      else if (replicas != 1) conflict = "-E";
+      if (conflict != NULL)
+	{
+	  fprintf(stderr, "mrfseg: -A can't be used with %s\n", conflict);
+	  return 1;
+	}
+    }
+  if (bitboard)
+    {
+      const char *conflict = NULL;
+      char buffer[32];
+      if (code != MRFEngine::METROPOLIS && code != MRFEngine::MMD)
+	conflict = method;
+      else if (no_regions != 2)
+	{
+	  sprintf(buffer, "%d classes", no_regions);
+	  conflict = buffer;
+	}
+      else if (neighbourhood != 4)
+	{
+	  sprintf(buffer, "-N %d", neighbourhood);
+	  conflict = buffer;
+	}
+      else if (tile_size > 0) conflict = "-x";
+      else if (replicas != 1) conflict = "-E";
+      if (conflict != NULL)
+	{
+	  fprintf(stderr, "mrfseg: -B can't be used with %s\n", conflict);
+	  return 1;
+	}
+    }
+
+  int width, height, channels;
+  if (tile_size > 0)
+    {
+      engine = &tiled;
+      if (!tiled.Open(in_name))
+	{
+	  fprintf(stderr, "mrfseg: can't read image %s\n", in_name);
+	  return 1;
+	}
+      tiled.SetTileSize(tile_size);
+      width = tiled.GetImageWidth();
+      height = tiled.GetImageHeight();
+    }
+  else
+    {
+      engine = &in_core;
+      unsigned char *in_data = ReadPNM(in_name, width, height, channels);
+      if (in_data == NULL)
+	{
+	  fprintf(stderr, "mrfseg: can't read image %s\n", in_name);
+	  return 1;
+	}
+      engine->SetImage(in_data, width, height, channels);
+      delete [] in_data;
+    }
+  engine->SetSIMD(simd);
+  engine->SetVerify(verify && tile_size == 0);
+  engine->SetCheckerboard(checkerboard);
+  engine->SetBitboard(bitboard);
+  engine->SetAdaptive(adaptive);
+  if (fixed_seed) engine->SetSeed(seed);
+  engine->SetThreads(threads);
+  engine->SetLevels(levels);
+  engine->SetGenerator(generator);
+  engine->SetPrecision(precision);
+  engine->SetReplicas(replicas, T_min);
+  if (!engine->SetNeighbourhood(neighbourhood)) Usage();
+
+  if (no_regions > 256 || !engine->SetNoRegions(no_regions))
+    {
+      fprintf(stderr, "mrfseg: too many classes (the output is 8 bit)\n");
+      return 1;
+    }
+  for (i=0; i<no_regions && estimate == 0; ++i)
+    {
+      int *r = rect + i*4;
+      if (r[0] == -1)
+	engine->SetClass(i, gauss[i*2], gauss[i*2+1]);
+      else if (!(tile_size > 0 ?
+		 tiled.CalculateMeanAndVariance(i, r[0], r[1], r[2], r[3]) :
+		 engine->CalculateMeanAndVariance(i, r[0], r[1], r[2], r[3])))
+	{
+	  fprintf(stderr, "mrfseg: rectangle of class %d is outside "
+		  "the image\n", i+1);
+	  return 1;
+	}
+      if (verbose)
+	fprintf(stderr, "%d\t%g\t%g\n", i+1, engine->GetMean(i),
+		engine->GetVariance(i));
+    }
+  delete [] gauss;
+  delete [] rect;
+  if (estimate > 0 && jobs >= 0)
+    {
+      engine->EstimateClasses();
+      if (verbose)
+	for (i=0; i<no_regions; ++i)
+	  fprintf(stderr, "%d\t%g\t%g\n", i+1, engine->GetMean(i),
+		  engine->GetVariance(i));
+    }
+
+  engine->SetBeta(beta);
+  engine->SetT(t);
+  engine->SetT0(T0);
+  engine->SetC(c);
+  engine->SetAlpha(alpha);
+
+  if (jobs >= 0)
+    {
+      /* batch mode: the engine is the model of the batch engines
+       */
+      int n = no_files/2;
+      const char **in_names = new const char*[n];
+      const char **out_names = new const char*[n];
+      for (i=0; i<n; ++i)
+	{
+	  in_names[i] = files[2*i];
+	  out_names[i] = files[2*i+1];
+	}
+      MRFBatch batch(*engine, code);
+      batch.SetJobs(jobs);
+      bool ok = batch.Run(n, in_names, out_names);
+      for (i=0; i<n; ++i)
+	if (batch.IsOK(i))
+	  printf("%s	iterations = %d	global energy = %g\n", in_names[i],
+		 batch.GetK(i), batch.GetE(i));
+	else
+	  fprintf(stderr, "mrfseg: can't segment %s into %s\n", in_names[i],
+		  out_names[i]);
+      printf("images = %d\nwall time = %g ms\nimages/sec = %g\n", n,
+	     batch.GetWallTimeMs(), batch.GetImagesPerSec());
+      delete [] in_names;
+      delete [] out_names;
+      delete [] files;
+      return ok ? 0 : 1;
+    }
+  delete [] files;
+
+  Telemetry telemetry(100000);
+  if (telemetry_name != NULL) engine->SetTelemetry(&telemetry);
+
+  timer.Reset();       // reset timer
+  timer.Start();       // start timer
+  bool ok = true;
+  int rounds = 0;
+  if (tile_size > 0)
+    ok = tiled.Segment(code, out_name); // writes the labeling itself
+  else if (estimate > 0)
+    rounds = engine->OptimizeUnsupervised(code);
+  else
+    engine->Optimize(code);
+  timer.Stop();        // stop timer
+
+  if (tile_size == 0)
+    {
+      unsigned char *out_data = new unsigned char[width*height];
+      for (i=0; i<height; ++i)
+	for (j=0; j<width; ++j)
+	  out_data[i*width+j] = (unsigned char)engine->GetLabel(i, j);
+      ok = WritePGM(out_name, out_data, width, height, no_regions-1);
+      delete [] out_data;
+    }
+  if (!ok)
+    {
+      fprintf(stderr, "mrfseg: can't write image %s\n", out_name);
+      return 1;
+    }
+  if (telemetry_name != NULL)
+    {
+      size_t len = strlen(telemetry_name);
+      if (len >= 5 && strcmp(telemetry_name + len-5, ".json") == 0)
+	ok = telemetry.WriteJSON(telemetry_name);
+      else
+	ok = telemetry.WriteCSV(telemetry_name);
+      if (!ok)
+	{
+	  fprintf(stderr, "mrfseg: can't write %s\n", telemetry_name);
+	  return 1;
+	}
+    }
+
+  printf("iterations = %d\nglobal energy = %g\nCPU time = %g ms\n",
+	 engine->GetK(), engine->GetE(), timer.GetElapsedTimeMs());
+  if (estimate > 0)
+    {
+      printf("rounds = %d\n", rounds);
+      for (i=0; i<no_regions; ++i)
+	printf("class %d = %g,%g\n", i+1, engine->GetMean(i),
+	       engine->GetVariance(i));
+    }
+  if (verify && tile_size == 0)
+    {
+      printf("energy error = %g\n", engine->GetEnergyError());
+      if (precision != MRFEngine::FLOAT64)
+	printf("agreement = %g\n", engine->GetAgreement());
+    }
+  return 0;
+}
@@ -0,0 +1,149 @@
+/******************************************************************
+ * Modul name : neighbourhood.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Neighbourhood systems of the Potts doubleton potential. A stencil
+ * is a class with the number of neighbours (size), the largest
+ * coordinate offset (reach) and the offsets Di(k), Dj(k) of the k-th
+ * neighbour. The first size/2 neighbours are the "forward" ones
+ * (south of the site, or east of it in the same row); neighbour
+ * k+size/2 is the mirror image of neighbour k, so every clique is
+ * counted once from the forward ones.
+ *
+ * The optimizers of MRFEngine are templates of the stencil: the
+ * neighbour loops have a constant trip count and constant offsets, so
+ * they are unrolled by the compiler, and only the sites within reach
+ * of the image border need bounds checks.
+ *
+ *****************************************************************/
+
+#ifndef NEIGHBOURHOOD_H
+#define NEIGHBOURHOOD_H
+
+#include "imagebuffer.h"
+
+#define MRF_MAX_NEIGHBOURS 24	// size of the largest stencil
+
+#if defined(__GNUC__) && (__GNUC__ >= 8 || defined(__clang__))
+#define UNROLL_STENCIL _Pragma("GCC unroll 24")
+#else
+#define UNROLL_STENCIL
+#endif
+
+
+/* First order: south, east, north, west
+ */
+struct Neighbourhood4
+{
+  enum { size = 4, reach = 1 };
+  static int Di(int k) { static const int d[] = { 1, 0, -1, 0 }; return d[k]; }
+  static int Dj(int k) { static const int d[] = { 0, 1, 0, -1 }; return d[k]; }
+};
+
+
+/* Second order: the 8 sites of the 3x3 window
+ */
+struct Neighbourhood8
+{
+  enum { size = 8, reach = 1 };
+  static int Di(int k)
+  {
+    static const int d[] = { 1, 0, 1, 1, -1, 0, -1, -1 };
+    return d[k];
+  }
+  static int Dj(int k)
+  {
+    static const int d[] = { 0, 1, 1, -1, 0, -1, -1, 1 };
+    return d[k];
+  }
+};
+
+
+/* The 24 sites of the 5x5 window (fifth order), for textures with
+ * longer range interactions
+ */
+struct Neighbourhood24
+{
+  enum { size = 24, reach = 2 };
+  static int Di(int k)
+  {
+    static const int d[] = { 1, 0, 1, 1, 2, 0, 2, 2, 1, 1, 2, 2,
+			     -1, 0, -1, -1, -2, 0, -2, -2, -1, -1, -2, -2 };
+    return d[k];
+  }
+  static int Dj(int k)
+  {
+    static const int d[] = { 0, 1, 1, -1, 0, 2, 1, -1, 2, -2, 2, -2,
+			     0, -1, -1, 1, 0, -2, -1, 1, -2, 2, -2, 2 };
+    return d[k];
+  }
+};
+
+
+/* Labels of the neighbours of site (i,j) (p points to its label) in
+ * stencil order, -1 for the ones outside of the image. Returns the
+ * number of neighbours inside.
+ */
+template <class S>
+inline int Neighbours(const label_t *p, int stride, int i, int j,
+		      int width, int height, int *n)
+{
+  int k;
+
+  if (i >= S::reach && i < height-S::reach &&
+      j >= S::reach && j < width-S::reach)
+    {
+      UNROLL_STENCIL
+      for (k=0; k<S::size; ++k)
+	n[k] = p[S::Di(k)*stride + S::Dj(k)];
+      return S::size;
+    }
+  int nb = 0;
+  for (k=0; k<S::size; ++k)
+    {
+      int y = i + S::Di(k), x = j + S::Dj(k);
+      if (y >= 0 && y < height && x >= 0 && x < width)
+	{
+	  n[k] = p[S::Di(k)*stride + S::Dj(k)];
+	  ++nb;
+	}
+      else
+	n[k] = -1;
+    }
+  return nb;
+}
+
+
+/* Potts doubleton potential of a label (n as given by Neighbours()):
+ * -beta for each neighbour having the same label, +beta for each
+ * other one, summed in stencil order
+ */
+template <class S>
+inline double Potts(const int *n, int label, double beta)
+{
+  double energy = 0.0;
+  UNROLL_STENCIL
+  for (int k=0; k<S::size; ++k)
+    if (n[k] >= 0)
+      {
+	if (label == n[k]) energy -= beta;
+	else energy += beta;
+      }
+  return energy;
+}
+
+
+/* Number of neighbours having a label
+ */
+template <class S>
+inline int Agreements(const int *n, int label)
+{
+  int agree = 0;
+  UNROLL_STENCIL
+  for (int k=0; k<S::size; ++k)
+    agree += (n[k] == label);
+  return agree;
+}
+
+
+#endif
@@ -0,0 +1,93 @@
+/******************************************************************
+ * Modul name : philox.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Counter-based random number generator Philox4x32-10 described in
+ * J. K. Salmon, M. A. Moraes, R. O. Dror, D. E. Shaw: Parallel random
+ * numbers: as easy as 1, 2, 3. Proc. SC'11, 2011.
+ *
+ * Unlike TRandomMersenne, the generator has no sequential state: the
+ * numbers are a bijective function of a key (the seed) and of a 128
+ * bit counter. The samplers set the counter to the (sweep, pixel)
+ * pair before visiting a pixel, so the numbers used at a pixel do not
+ * depend on the order in which the pixels are visited, nor on the
+ * number of threads.
+ *
+ * The member functions Random(), IRandom() and BRandom() behave as in
+ * TRandomMersenne (see randomc.h). The numbers of a given counter are
+ * returned by successive calls, after the first four the last word of
+ * the counter is incremented.
+ *
+ *****************************************************************/
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <stdint.h>
+
+
+class TRandomPhilox
+{
+public:
+  TRandomPhilox(uint64_t seed) { RandomInit(seed); }
+  void RandomInit(uint64_t seed)	// re-seed
+  {
+    key[0] = (uint32_t)seed;
+    key[1] = (uint32_t)(seed >> 32);
+    SetCounter(0, 0);
+  }
+  void SetCounter(uint64_t index, uint32_t stream) // jump to the numbers
+  {						   // of (index, stream)
+    ctr[0] = (uint32_t)index;
+    ctr[1] = (uint32_t)(index >> 32);
+    ctr[2] = stream;
+    ctr[3] = 0;
+    next = 4;
+  }
+  uint32_t BRandom()			// output random bits
+  {
+    if (next == 4) Generate();
+    return out[next++];
+  }
+  double Random()			// output random float in [0,1)
+  {
+    return BRandom() * (1.0/4294967296.0);
+  }
+  int IRandom(int min, int max)		// output random integer
+  {
+    if (max < min) return 0x80000000;
+    int r = int((max - min + 1) * Random()) + min;
+    return (r > max ? max : r);
+  }
+
+private:
+  uint32_t key[2];
+  uint32_t ctr[4];
+  uint32_t out[4];			// numbers of the current counter
+  int next;				// index into out
+
+  void Generate()
+  {
+    uint32_t c[4] = { ctr[0], ctr[1], ctr[2], ctr[3] };
+    uint32_t k[2] = { key[0], key[1] };
+    for (int round=0; round<10; ++round)
+      {
+	uint64_t p0 = (uint64_t)0xD2511F53 * c[0];
+	uint64_t p1 = (uint64_t)0xCD9E8D57 * c[2];
+	uint32_t t[4];
+	t[0] = (uint32_t)(p1 >> 32) ^ c[1] ^ k[0];
+	t[1] = (uint32_t)p1;
+	t[2] = (uint32_t)(p0 >> 32) ^ c[3] ^ k[1];
+	t[3] = (uint32_t)p0;
+	c[0] = t[0]; c[1] = t[1]; c[2] = t[2]; c[3] = t[3];
+	k[0] += 0x9E3779B9;		// Weyl sequence of the key
+	k[1] += 0xBB67AE85;
+      }
+    out[0] = c[0]; out[1] = c[1]; out[2] = c[2]; out[3] = c[3];
+    ++ctr[3];
+    next = 0;
+  }
+};
+
+
+#endif
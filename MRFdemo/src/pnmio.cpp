@@ -0,0 +1,174 @@
+/******************************************************************
+ * Modul name : pnmio.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Minimal reader/writer for binary PGM (P5) and PPM (P6) images.
+ *
+ *****************************************************************/
+
+#define _FILE_OFFSET_BITS 64	// images larger than 2 GB
+
+#include "pnmio.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#define ftello _ftelli64
+#define fseeko _fseeki64
+typedef long long off_t;
+#endif
+
+
+/* Reads the next integer of a PNM header, skipping white space and
+ * comments. Returns -1 on error.
+ */
+static int ReadHeaderInt(FILE *f)
+{
+  int ch, value;
+
+  do
+    {
+      ch = fgetc(f);
+      if (ch == '#')		// comment till the end of line
+	while (ch != '\n' && ch != EOF) ch = fgetc(f);
+    } while (ch != EOF && isspace(ch));
+  if (ch == EOF || !isdigit(ch)) return -1;
+  value = 0;
+  while (ch != EOF && isdigit(ch))
+    {
+      value = value*10 + (ch-'0');
+      ch = fgetc(f);
+    }
+  // ch is the single white space character ending the field
+  return value;
+}
+
+
+unsigned char *ReadPNM(const char *file_name, int &width, int &height,
+		       int &channels)
+{
+  FILE *f = fopen(file_name, "rb");
+  if (f == NULL) return NULL;
+
+  unsigned char *data = NULL;
+  int maxval;
+  char magic[2];
+  if (fread(magic, 1, 2, f) == 2 && magic[0] == 'P' &&
+      (magic[1] == '5' || magic[1] == '6'))
+    {
+      channels = (magic[1] == '5' ? 1 : 3);
+      width = ReadHeaderInt(f);
+      height = ReadHeaderInt(f);
+      maxval = ReadHeaderInt(f);
+      if (width > 0 && height > 0 && maxval > 0 && maxval < 256)
+	{
+	  size_t size = (size_t)width*height*channels;
+	  data = new unsigned char[size];
+	  if (fread(data, 1, size, f) != size)
+	    {
+	      delete [] data;
+	      data = NULL;
+	    }
+	}
+    }
+  fclose(f);
+  return data;
+}
+
+
+bool WritePGM(const char *file_name, const unsigned char *data,
+	      int width, int height, int maxval)
+{
+  FILE *f = fopen(file_name, "wb");
+  if (f == NULL) return false;
+
+  size_t size = (size_t)width*height;
+  bool ok = fprintf(f, "P5\n%d %d\n%d\n", width, height, maxval) > 0 &&
+    fwrite(data, 1, size, f) == size;
+  return (fclose(f) == 0) && ok;
+}
+
+
+bool PNMFile::Open(const char *file_name)
+{
+  Close();
+  if ((f = fopen(file_name, "rb")) == NULL) return false;
+
+  int maxval;
+  char magic[2];
+  if (fread(magic, 1, 2, f) == 2 && magic[0] == 'P' &&
+      (magic[1] == '5' || magic[1] == '6'))
+    {
+      channels = (magic[1] == '5' ? 1 : 3);
+      width = ReadHeaderInt(f);
+      height = ReadHeaderInt(f);
+      maxval = ReadHeaderInt(f);
+      if (width > 0 && height > 0 && maxval > 0 && maxval < 256)
+	{
+	  data_offset = ftello(f);
+	  if (channels > 1) buf = new unsigned char[(size_t)width*channels];
+	  return true;
+	}
+    }
+  Close();
+  return false;
+}
+
+
+bool PNMFile::Create(const char *file_name, int w, int h, int maxval)
+{
+  Close();
+  if ((f = fopen(file_name, "w+b")) == NULL) return false;
+
+  width = w;
+  height = h;
+  channels = 1;
+  if (fprintf(f, "P5\n%d %d\n%d\n", width, height, maxval) > 0)
+    {
+      data_offset = ftello(f);
+      /* set the size of the file by writing its last byte
+       */
+      if (Seek(height-1, width-1) && fputc(0, f) != EOF) return true;
+    }
+  Close();
+  return false;
+}
+
+
+bool PNMFile::Close()
+{
+  bool ok = true;
+  if (f != NULL) ok = (fclose(f) == 0);
+  f = NULL;
+  delete [] buf;
+  buf = NULL;
+  width = height = channels = 0;
+  return ok;
+}
+
+
+bool PNMFile::Seek(int row, int col)
+{
+  long long pos = data_offset + ((long long)row*width + col)*channels;
+  return fseeko(f, (off_t)pos, SEEK_SET) == 0;
+}
+
+
+bool PNMFile::Read(int row, int col, int n, unsigned char *data)
+{
+  if (!Seek(row, col)) return false;
+  if (channels == 1) return fread(data, 1, n, f) == (size_t)n;
+
+  if (fread(buf, channels, n, f) != (size_t)n) return false;
+  for (int j=0; j<n; ++j) data[j] = buf[j*channels];
+  return true;
+}
+
+
+bool PNMFile::Write(int row, int col, int n, const unsigned char *data)
+{
+  return channels == 1 && Seek(row, col) &&
+    fwrite(data, 1, n, f) == (size_t)n;
+}
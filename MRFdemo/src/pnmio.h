@@ -0,0 +1,70 @@
+/******************************************************************
+ * Modul name : pnmio.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Minimal reader/writer for binary PGM (P5) and PPM (P6) images, so
+ * that the segmentation engine can be used without wxWidgets.
+ * PNMFile gives random access to the rows of an image on disk, which
+ * is needed to process images larger than the memory tile by tile.
+ *
+ *****************************************************************/
+
+#ifndef PNMIO_H
+#define PNMIO_H
+
+#include <stdio.h>
+
+
+/* Reads a binary PGM or PPM file with maxval <= 255. Returns the
+ * interleaved pixel data (allocated with new[], channels is 1 or 3)
+ * or NULL on error.
+ */
+unsigned char *ReadPNM(const char *file_name, int &width, int &height,
+		       int &channels);
+
+/* Writes a binary PGM file with the given maxval (<= 255). Returns
+ * false on error.
+ */
+bool WritePGM(const char *file_name, const unsigned char *data,
+	      int width, int height, int maxval=255);
+
+
+/* Binary PGM/PPM file (maxval <= 255) accessed in place
+ */
+class PNMFile
+{
+public:
+  PNMFile() { f = NULL; width = height = channels = 0; buf = NULL; }
+  ~PNMFile() { Close(); }
+
+  bool Open(const char *file_name);	// opens an existing image for
+					// reading
+  bool Create(const char *file_name,	// creates a PGM image of the
+	      int w, int h,		// given size (filled with 0)
+	      int maxval=255);		// for reading and writing
+  bool Close();				// false if an error occurred
+
+  int GetWidth() { return width; }
+  int GetHeight() { return height; }
+  int GetChannels() { return channels; }
+
+  /* Read/write n pixels of a row starting at column col. Read() gives
+   * the first channel only, Write() works on PGM images only.
+   */
+  bool Read(int row, int col, int n, unsigned char *data);
+  bool Write(int row, int col, int n, const unsigned char *data);
+
+private:
+  FILE *f;
+  int width, height, channels;
+  long long data_offset;		// position of the first pixel
+  unsigned char *buf;			// a row of a PPM image
+
+  bool Seek(int row, int col);
+
+  PNMFile(const PNMFile &);		// not copyable
+  PNMFile &operator=(const PNMFile &);
+};
+
+
+#endif
@@ -0,0 +1,80 @@
+/******************************************************************
+ * Modul name : schedule.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Temperature schedules of the annealing optimizers (see schedule.h).
+ *
+ *****************************************************************/
+
+#include <math.h>
+
+#include "schedule.h"
+
+
+AnnealingSchedule::AnnealingSchedule(bool _adaptive, double _c,
+				     double _t, double sites)
+{
+  adaptive = _adaptive;
+  c = _c;
+  t = _t;
+  min_acceptance = (sites > 1.0 ? 1.0/sites : 1.0);
+  k = 0;
+  log_a0 = 0.0;
+  acceptance = 1.0;
+  frozen = false;
+}
+
+
+/* The target curve is the acceptance of the geometric schedule on a
+ * system whose moves have the same energy barrier U: a = exp(-U/T)
+ * gives log a(n) = log a(0) / c^n. The next temperature is the one at
+ * which the barrier estimated from the average acceptance,
+ * U = -T log a, meets the target. A real image has moves of many
+ * barriers: where the acceptance hardly depends on T (hot labelings,
+ * or only a few boundary sites flipping back and forth) the schedule
+ * cools faster than the geometric one, where the acceptance drops
+ * suddenly (the regions form) it holds the temperature until the
+ * target catches up. It never heats.
+ *
+ * The labeling is frozen when the energy of the last SCHEDULE_WINDOW
+ * sweeps, trend and fluctuation together, has a standard deviation
+ * of a few T: a handful of single site moves over the whole image.
+ * Hot labelings fluctuate far more than that, hence the test needs no
+ * guard against an early start.
+ */
+double AnnealingSchedule::Next(double T, double E, double a)
+{
+  if (!adaptive) return c*T;
+
+  if (a < min_acceptance) a = min_acceptance;
+  if (k == 0)
+    {
+      acceptance = a;
+      log_a0 = log(a < SCHEDULE_MAX_ACCEPTANCE ? a : SCHEDULE_MAX_ACCEPTANCE);
+    }
+  else
+    acceptance += SCHEDULE_MEMORY*(a - acceptance);
+  window[k % SCHEDULE_WINDOW] = E;
+  ++k;
+
+  if (k >= SCHEDULE_WINDOW)
+    {
+      double mean = 0.0, var = 0.0;
+      int n;
+      for (n=0; n<SCHEDULE_WINDOW; ++n) mean += window[n];
+      mean /= SCHEDULE_WINDOW;
+      for (n=0; n<SCHEDULE_WINDOW; ++n)
+	var += (window[n] - mean)*(window[n] - mean);
+      var /= SCHEDULE_WINDOW - 1;
+      double limit = (SCHEDULE_FREEZE*T > t ? SCHEDULE_FREEZE*T : t);
+      frozen = (var <= limit*limit);
+    }
+
+  double log_target = log_a0 / pow(c, k);
+  double log_a = log(acceptance < SCHEDULE_MAX_ACCEPTANCE ?
+		     acceptance : SCHEDULE_MAX_ACCEPTANCE);
+  double factor = log_a / log_target;
+  if (factor > 1.0) factor = 1.0;
+  if (factor < SCHEDULE_MIN_FACTOR) factor = SCHEDULE_MIN_FACTOR;
+  return factor*T;
+}
@@ -0,0 +1,56 @@
+/******************************************************************
+ * Modul name : schedule.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Temperature schedules of the annealing optimizers (Metropolis, MMD
+ * and Gibbs sampler). The geometric schedule is T(n+1) = c*T(n). The
+ * adaptive one measures the acceptance rate (the fraction of the
+ * labels changed by a sweep) and the energy of each sweep: it picks
+ * the next temperature so that the acceptance follows a target curve,
+ * and it reports the labeling frozen once the variance of the energy
+ * gets small, without waiting for the last few sites to settle.
+ *
+ *****************************************************************/
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#define SCHEDULE_MIN_FACTOR 0.5		// largest cooling step T(n+1)/T(n)
+#define SCHEDULE_MAX_ACCEPTANCE 0.5	// start of the target curve
+#define SCHEDULE_MEMORY 0.25		// weight of a sweep in the average
+					// acceptance
+#define SCHEDULE_WINDOW 8		// frozen when the standard
+#define SCHEDULE_FREEZE 4.0		// deviation of the energy of this
+					// many sweeps is below this many T
+					// (or below t)
+
+
+class AnnealingSchedule
+{
+public:
+  AnnealingSchedule(bool adaptive,	// false: geometric
+		    double c,		// cooling factor
+		    double t,		// stop criterion of the optimizer
+		    double sites);	// # of sites of the image
+
+  double Next(double T,			// records a sweep at temperature T
+	      double E,			// (E: energy after the sweep,
+	      double acceptance);	// acceptance: fraction of the
+					// changed labels) and returns
+					// the temperature of the next one
+  bool Frozen() { return frozen; }	// the energy doesn't change any
+					// more (never if geometric)
+
+private:
+  bool adaptive;
+  double c, t;
+  double min_acceptance;		// one site of the image
+  int k;				// # of sweeps recorded
+  double log_a0;			// log of the first acceptance
+  double acceptance;			// average acceptance
+  double window[SCHEDULE_WINDOW];	// energies of the last sweeps
+  bool frozen;
+};
+
+
+#endif
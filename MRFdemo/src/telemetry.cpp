@@ -0,0 +1,103 @@
+/******************************************************************
+ * Modul name : telemetry.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Per sweep record of an optimizer run (see telemetry.h).
+ *
+ *****************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "telemetry.h"
+
+
+static double CPUTimeMs()
+{
+  return clock() * (1000.0 / CLOCKS_PER_SEC);
+}
+
+
+Telemetry::Telemetry(int _capacity)
+{
+  capacity = (_capacity > 0 ? _capacity : 1);
+  records = new SweepRecord[capacity];
+  total = 0;
+  Lap();
+}
+
+
+Telemetry::~Telemetry()
+{
+  delete [] records;
+}
+
+
+void Telemetry::Clear()
+{
+  total = 0;
+  Lap();
+}
+
+
+void Telemetry::Lap()
+{
+  wall = std::chrono::steady_clock::now();
+  cpu = CPUTimeMs();
+}
+
+
+void Telemetry::Record(int level, int sweep, double T, double E,
+		       long accepted, long changed)
+{
+  std::chrono::steady_clock::time_point now =
+    std::chrono::steady_clock::now();
+  double now_cpu = CPUTimeMs();
+  SweepRecord &r = records[total % capacity];
+
+  r.level = level;
+  r.sweep = sweep;
+  r.T = T;
+  r.E = E;
+  r.accepted = accepted;
+  r.changed = changed;
+  r.wall_ms = std::chrono::duration<double, std::milli>(now - wall).count();
+  r.cpu_ms = now_cpu - cpu;
+  wall = now;
+  cpu = now_cpu;
+  ++total;
+}
+
+
+bool Telemetry::WriteCSV(const char *name)
+{
+  FILE *f = fopen(name, "w");
+  if (f == NULL) return false;
+  fprintf(f, "level,sweep,T,E,accepted,changed,wall_ms,cpu_ms\n");
+  for (int k=0; k<GetSize(); ++k)
+    {
+      const SweepRecord &r = Get(k);
+      fprintf(f, "%d,%d,%.10g,%.10g,%ld,%ld,%.3f,%.3f\n", r.level, r.sweep,
+	      r.T, r.E, r.accepted, r.changed, r.wall_ms, r.cpu_ms);
+    }
+  return fclose(f) == 0;
+}
+
+
+bool Telemetry::WriteJSON(const char *name)
+{
+  FILE *f = fopen(name, "w");
+  if (f == NULL) return false;
+  fprintf(f, "{\n  \"dropped\": %ld,\n  \"sweeps\": [", GetDropped());
+  for (int k=0; k<GetSize(); ++k)
+    {
+      const SweepRecord &r = Get(k);
+      fprintf(f, "%s\n    { \"level\": %d, \"sweep\": %d, \"T\": %.10g, "
+	      "\"E\": %.10g, \"accepted\": %ld, \"changed\": %ld, "
+	      "\"wall_ms\": %.3f, \"cpu_ms\": %.3f }", k > 0 ? "," : "",
+	      r.level, r.sweep, r.T, r.E, r.accepted, r.changed,
+	      r.wall_ms, r.cpu_ms);
+    }
+  fprintf(f, "\n  ]\n}\n");
+  return fclose(f) == 0;
+}
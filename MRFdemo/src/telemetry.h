@@ -0,0 +1,80 @@
+/******************************************************************
+ * Modul name : telemetry.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Per sweep record of an optimizer run: level, sweep #, temperature,
+ * energy, accepted moves, changed labels, wall and CPU time of the
+ * sweep. The records are kept in a ring buffer allocated once, so
+ * recording a sweep costs two clock reads and a few stores; when the
+ * buffer is full the oldest records are overwritten. The records can
+ * be written as CSV or JSON. A Telemetry is attached to an engine
+ * with MRFEngine::SetTelemetry() and filled by the thread running
+ * the optimizer only.
+ *
+ *****************************************************************/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <chrono>
+
+
+struct SweepRecord
+{
+  int level;			// resolution level (0: full resolution)
+  int sweep;			// # of the sweep within its run (K)
+  double T;			// temperature of the sweep (the
+				// last one for ICM and graph cut)
+  double E;			// energy after the sweep
+  long accepted;		// moves accepted: relabeled clusters
+				// (Swendsen-Wang), expansions which
+				// changed labels (graph cut),
+				// exchanges (replicas); for the
+				// single site updates = changed
+  long changed;			// labels changed
+  double wall_ms;		// wall and CPU (all threads) time of
+  double cpu_ms;		// the sweep
+};
+
+
+class Telemetry
+{
+public:
+  Telemetry(int capacity=4096);		// # of records kept
+  ~Telemetry();
+
+  void Clear();				// removes all records
+  void Lap();				// times the next sweep from now
+					// (called when a run starts)
+  void Record(int level, int sweep, double T, double E,
+	      long accepted, long changed);
+
+  int GetSize()				// # of records kept
+  {
+    return total < capacity ? (int)total : capacity;
+  }
+  long GetDropped()			// # of records overwritten
+  {
+    return total - GetSize();
+  }
+  const SweepRecord &Get(int k)		// k-th oldest record kept
+  {
+    return records[(total - GetSize() + k) % capacity];
+  }
+
+  bool WriteCSV(const char *name);	// false on error
+  bool WriteJSON(const char *name);
+
+private:
+  SweepRecord *records;
+  int capacity;
+  long total;				// # of records ever recorded
+  std::chrono::steady_clock::time_point wall; // time of the last
+  double cpu;				      // lap or record
+
+  Telemetry(const Telemetry &);		// not copyable
+  Telemetry &operator=(const Telemetry &);
+};
+
+
+#endif
@@ -0,0 +1,86 @@
+/******************************************************************
+ * Modul name : threadpool.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Fork-join pool of worker threads.
+ *
+ *****************************************************************/
+
+#include "threadpool.h"
+
+
+ThreadPool::ThreadPool(int n)
+{
+  no_threads = (n > 0 ? n : NoCores());
+  job = NULL;
+  arg = NULL;
+  generation = 0;
+  running = 0;
+  quit = false;
+  workers = new std::thread[no_threads-1];
+  for (int k=1; k<no_threads; ++k)
+    workers[k-1] = std::thread(&ThreadPool::Worker, this, k);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  start.notify_all();
+  for (int k=1; k<no_threads; ++k)
+    workers[k-1].join();
+  delete [] workers;
+}
+
+
+int ThreadPool::NoCores()
+{
+  int n = (int)std::thread::hardware_concurrency();
+  return (n > 0 ? n : 1);
+}
+
+
+void ThreadPool::Run(Job _job, void *_arg)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = _job;
+    arg = _arg;
+    running = no_threads-1;
+    ++generation;
+  }
+  start.notify_all();
+
+  _job(_arg, 0);		// the caller is thread 0
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (running > 0)
+    done.wait(lock);
+}
+
+
+void ThreadPool::Worker(int k)
+{
+  unsigned long seen = 0;	// last generation executed
+
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;)
+    {
+      while (!quit && generation == seen)
+	start.wait(lock);
+      if (quit) return;
+      seen = generation;
+      Job _job = job;
+      void *_arg = arg;
+      lock.unlock();
+
+      _job(_arg, k);
+
+      lock.lock();
+      if (--running == 0)
+	done.notify_one();
+    }
+}
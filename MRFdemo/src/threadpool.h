@@ -0,0 +1,49 @@
+/******************************************************************
+ * Modul name : threadpool.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Fork-join pool of worker threads. Run() executes the same job on
+ * every thread (each one gets its own index, so it can pick its
+ * part of the work) and returns when all of them have finished.
+ * The threads are created once and sleep between two Run() calls.
+ *
+ *****************************************************************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+class ThreadPool
+{
+public:
+  typedef void (*Job)(void *arg, int thread);
+
+  ThreadPool(int n=0);	     // n threads (n<=0: one per CPU core)
+  ~ThreadPool();
+
+  int GetNoThreads() { return no_threads; }
+  void Run(Job job, void *arg); // calls job(arg, k) for k=0..n-1 in
+				// parallel. Thread 0 is the caller.
+
+  static int NoCores();	     // number of CPU cores (at least 1)
+
+private:
+  int no_threads;
+  std::thread *workers;	     // threads 1..n-1
+  std::mutex mutex;
+  std::condition_variable start, done;
+  Job job;		     // current job and its argument
+  void *arg;
+  unsigned long generation;  // incremented by each Run()
+  int running;		     // number of workers still working
+  bool quit;		     // set by the destructor
+
+  void Worker(int k);	     // main loop of worker thread k
+};
+
+
+#endif
@@ -0,0 +1,194 @@
+/******************************************************************
+ * Modul name : tiled.cpp
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Out-of-core tiled segmentation engine (see tiled.h).
+ *
+ *****************************************************************/
+
+#include "tiled.h"
+
+#include <math.h>
+
+#include "randomc.h"
+#include "schedule.h"
+#include "telemetry.h"
+
+
+TiledEngine::TiledEngine()
+{
+  tile_size = 1024;
+  row = NULL;
+}
+
+
+TiledEngine::~TiledEngine()
+{
+  delete [] row;
+}
+
+
+bool TiledEngine::Open(const char *in_name)
+{
+  if (!image.Open(in_name)) return false;
+  delete [] row;
+  row = new unsigned char[image.GetWidth()];
+  return true;
+}
+
+
+bool TiledEngine::CalculateMeanAndVariance(int region, int x, int y,
+					   int w, int h)
+{
+  if (x < 0 || y < 0 || w < 1 || h < 1 || x > image.GetWidth() - w ||
+      y > image.GetHeight() - h) return false;
+  width = w;
+  height = h;
+  in_image_data.Resize(w, h);
+  moments[0].Clear();		// the tables are of the previous rectangle
+  for (int i=0; i<h; ++i)
+    if (!image.Read(y+i, x, w, in_image_data.Row(i))) return false;
+  return MRFEngine::CalculateMeanAndVariance(region, 0, 0, w, h);
+}
+
+
+/* Reads tile (ti,tj) and its halo into in_image_data and, if
+ * with_labels is true, into classes.
+ */
+bool TiledEngine::LoadTile(int ti, int tj, bool with_labels)
+{
+  int W = image.GetWidth(), H = image.GetHeight();
+  int top, left, i, j;
+
+  tile_i0 = ti*tile_size;
+  tile_j0 = tj*tile_size;
+  top = (tile_i0 > 0);
+  left = (tile_j0 > 0);
+  i0 = top;
+  j0 = left;
+  i1 = i0 + (tile_i0+tile_size < H ? tile_size : H-tile_i0);
+  j1 = j0 + (tile_j0+tile_size < W ? tile_size : W-tile_j0);
+  height = i1 + (tile_i0+tile_size < H);
+  width = j1 + (tile_j0+tile_size < W);
+
+  in_image_data.Resize(width, height);
+  for (i=0; i<height; ++i)
+    if (!image.Read(tile_i0-top+i, tile_j0-left, width, in_image_data.Row(i)))
+      return false;
+  if (with_labels)
+    {
+      classes.Resize(width, height);
+      for (i=0; i<height; ++i)
+	{
+	  if (!labels.Read(tile_i0-top+i, tile_j0-left, width, row))
+	    return false;
+	  label_t *l = classes.Row(i);
+	  for (j=0; j<width; ++j) l[j] = row[j];
+	}
+    }
+  return true;
+}
+
+
+bool TiledEngine::StoreTile()
+{
+  for (int i=i0; i<i1; ++i)
+    {
+      const label_t *l = classes.Row(i);
+      for (int j=j0; j<j1; ++j) row[j-j0] = (unsigned char)l[j];
+      if (!labels.Write(tile_i0+i-i0, tile_j0, j1-j0, row)) return false;
+    }
+  return true;
+}
+
+
+bool TiledEngine::Segment(int method, const char *out_name)
+{
+  int W = image.GetWidth(), H = image.GetHeight();
+  int ti, tj;
+  int no_ti = (H + tile_size-1) / tile_size;  // number of tiles
+  int no_tj = (W + tile_size-1) / tile_size;
+  double kszi = log(alpha);	// for MMD
+  double summa_deltaE;
+  double dE;			// energy change of ICM and Gibbs
+  bool ok = true;
+
+  if ((method != METROPOLIS && method != MMD && method != ICM_RASTER &&
+       method != GIBBS) || neighbourhood != 4)
+    return false;
+  if (W == 0 || no_regions > 256 || !labels.Create(out_name, W, H, no_regions-1))
+    return false;
+
+  TRandomMersenne rg(Seed());
+  double *Ek = new double[no_regions];
+  if (method == METROPOLIS &&
+      256.0*no_regions*no_regions <= (double)tile_size*tile_size)
+    boltzmann_ratios = new double[256*no_regions*no_regions];
+  if (method == MMD) InitReduced(false);
+  AnnealingSchedule schedule(adaptive, c, t, (double)W*H);
+
+  /* maximum likelihood labeling and its energy
+   */
+  E_old = 0.0;
+  for (ti=0; ti<no_ti && ok; ++ti)
+    for (tj=0; tj<no_tj && ok; ++tj)
+      {
+	ok = LoadTile(ti, tj, false);
+	InitOutImage();
+	E_old += CalculateEnergy(i0, i1, j0, j1);
+	ok = ok && StoreTile();
+      }
+  E = E_old;
+
+  K = 0;
+  T = T0;
+  if (telemetry != NULL) telemetry->Lap();
+  while (ok)
+    {
+      summa_deltaE = 0.0;
+      dE = 0.0;
+      changes = 0;
+      if (method == METROPOLIS) InitBoltzmann(false);
+      if (method == GIBBS) InitBoltzmann(true);
+      for (ti=0; ti<no_ti && ok; ++ti)
+	for (tj=0; tj<no_tj && ok; ++tj)
+	  {
+	    ok = LoadTile(ti, tj, true);
+	    switch (method)
+	      {
+	      case METROPOLIS:
+	      case MMD:		// update E_old
+		MetropolisSweep<Neighbourhood4>(rg, method == MMD, kszi,
+						summa_deltaE, i0, i1, j0, j1);
+		break;
+	      case ICM_RASTER:
+		ICMSweep<Neighbourhood4>(dE, i0, i1, j0, j1);
+		break;
+	      case GIBBS:
+		GibbsSweep<Neighbourhood4>(rg, Ek, dE, i0, i1, j0, j1);
+		break;
+	      }
+	    ok = ok && StoreTile();
+	  }
+      if (method == ICM_RASTER || method == GIBBS)
+	{
+	  summa_deltaE = fabs(dE);
+	  E_old += dE;
+	}
+      E = E_old;
+      RecordSweep(K+1, changes);
+
+      if (method != ICM_RASTER)	// decrease temperature
+	T = schedule.Next(T, E, GetAcceptance());
+      ++K;	      // advance iteration counter
+      OnIteration();  // report progress (the current tile is in memory)
+      if (schedule.Frozen()) break; // stop when the labeling freezes
+      if (summa_deltaE <= t &&	    // or the energy change is small
+	  !(adaptive && method == GIBBS)) break; // (see RunGibbs())
+    }
+
+  delete [] Ek;
+  delete [] boltzmann_ratios;
+  boltzmann_ratios = NULL;
+  return labels.Close() && ok;
+}
@@ -0,0 +1,70 @@
+/******************************************************************
+ * Modul name : tiled.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Out-of-core segmentation of images which do not fit in the memory.
+ * The input image and the labeling both stay on disk as binary
+ * PGM/PPM files, and only one tile is in memory at a time, together
+ * with a one pixel halo of the neighbouring tiles. An iteration reads
+ * the tiles one after the other with the current labels of their
+ * halo, sweeps over the sites of the tile (the halo is kept fixed)
+ * and writes the new labels back. The next tiles thus see these
+ * labels in their halo, and after the iteration the labeling is the
+ * same as after a raster scan sweep of the whole image in tile order.
+ *
+ *****************************************************************/
+
+#ifndef TILED_H
+#define TILED_H
+
+#include "mrfengine.h"
+#include "pnmio.h"
+
+
+class TiledEngine: public MRFEngine
+{
+public:
+  TiledEngine();
+  ~TiledEngine();
+
+  bool Open(const char *in_name);	// opens the input image (binary
+					// PGM/PPM), false on error
+  int GetImageWidth() { return image.GetWidth(); }
+  int GetImageHeight() { return image.GetHeight(); }
+  void SetTileSize(int n) { tile_size = n; } // width and height of the
+					     // tiles (default: 1024)
+  double GetAcceptance()		// of the whole image
+  {
+    return image.GetWidth() > 0 ? (double)changes /
+      ((double)image.GetWidth()*image.GetHeight()) : 0.0;
+  }
+
+  bool CalculateMeanAndVariance(int region, // computes mean and
+				int x, int y,  // variance of a training
+				int w, int h); // rectangle of the image
+					       // (false as the engine's)
+
+  /* Segments the image with METROPOLIS, MMD, ICM_RASTER or GIBBS and
+   * writes the labeling to out_name as a PGM image (pixel value =
+   * label, at most 256 classes). Returns false on I/O errors, for
+   * the other methods and for neighbourhoods other than 4.
+   */
+  bool Segment(int method, const char *out_name);
+
+private:
+  PNMFile image;			// input image
+  PNMFile labels;			// labeling (the output)
+  int tile_size;
+  unsigned char *row;			// a row of labels
+  int tile_i0, tile_j0;			// first site of the tile in the
+					// image
+  int i0, i1, j0, j1;			// the tile without the halo
+					// within the buffers
+
+  bool LoadTile(int ti, int tj,		// reads the image (and the
+		bool with_labels);	// labeling) of a tile
+  bool StoreTile();			// writes back the labeling
+};
+
+
+#endif
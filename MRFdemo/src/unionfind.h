@@ -0,0 +1,72 @@
+/******************************************************************
+ * Modul name : unionfind.h
+ * Copyright  : GNU General Public License www.gnu.org/copyleft/gpl.html
+ * Description:
+ * Disjoint-set forest of the sites of an image (index i*width+j),
+ * used for the connected components of the Swendsen-Wang sampler.
+ * The root of a set is always its smallest element, so the forest
+ * only depends on the sets, not on the order of the unions. Threads
+ * may link disjoint ranges of elements at the same time; Root() does
+ * not modify the forest and may be called concurrently once the
+ * unions are done.
+ *
+ *****************************************************************/
+
+#ifndef UNIONFIND_H
+#define UNIONFIND_H
+
+#include <stddef.h>
+
+
+class UnionFind
+{
+public:
+  UnionFind() { parent = NULL; size = 0; }
+  ~UnionFind() { delete [] parent; }
+
+  void Resize(int n)			// n elements (content undefined)
+  {
+    if (n > size)
+      {
+	delete [] parent;
+	parent = new int[n];
+	size = n;
+      }
+  }
+  void Reset(int s0, int s1)		// makes [s0,s1) singletons
+  {
+    for (int s=s0; s<s1; ++s) parent[s] = s;
+  }
+
+  int Find(int s)			// root of s, halves the path
+  {
+    while (parent[s] != s)
+      {
+	parent[s] = parent[parent[s]];
+	s = parent[s];
+      }
+    return s;
+  }
+  int Root(int s) const			// root of s, read only
+  {
+    while (parent[s] != s) s = parent[s];
+    return s;
+  }
+  void Union(int a, int b)		// merges the sets of a and b
+  {
+    a = Find(a);
+    b = Find(b);
+    if (a < b) parent[b] = a;
+    else if (b < a) parent[a] = b;
+  }
+
+private:
+  int *parent;
+  int size;
+
+  UnionFind(const UnionFind &);		// not copyable
+  UnionFind &operator=(const UnionFind &);
+};
+
+
+#endif